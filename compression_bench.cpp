@@ -0,0 +1,72 @@
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include "src/Compression.h"
+#include "src/HttpOpts.h"
+#include "src/Utils.h"
+
+using namespace cW;
+
+// json-ish body, roughly what an api response compresses like
+std::string makeBody(size_t size)
+{
+    static const char* words[] = {"\"id\"", "\"name\"", "\"tweet\"", "\"user\"", "\"likes\"",
+                                  "true",   "false",    "null",      ":",        ","};
+    std::mt19937 rng(42);
+    std::string  body = "[";
+    while (body.size() < size) {
+        body += "{";
+        for (int i = 0; i < 6; i++) {
+            body += words[rng() % 10];
+            body += std::to_string(rng() % 100000);
+        }
+        body += "},";
+    }
+    body.resize(size);
+    return body;
+}
+
+// single thread, so the numbers are per core
+void bench(const char* name, const std::string& body, ContentEncoding encoding, int level)
+{
+    using namespace std::chrono;
+    size_t compressed = 0, rounds = 0;
+    auto   start      = steady_clock::now();
+    double elapsed    = 0;
+    while (elapsed < 1.0) {
+        compressed = compress(body, encoding, level).size();
+        rounds++;
+        elapsed = duration<double>(steady_clock::now() - start).count();
+    }
+    double mb = (double)body.size() * rounds / (1024 * 1024);
+    printf("%-20s %10.1f MB/s  ratio %.3f\n", name, mb / elapsed,
+           (double)compressed / body.size());
+}
+
+void benchCache(const std::string& body, ContentEncoding encoding)
+{
+    using namespace std::chrono;
+    size_t rounds = 0;
+    CompressionCache::get(body, encoding, 6);
+    auto start = steady_clock::now();
+    for (; rounds < 1000000; rounds++)
+        CompressionCache::get(body, encoding, 6);
+    double elapsed = duration<double>(steady_clock::now() - start).count();
+    printf("%-20s %10.1f ns/hit\n", "cache hit", elapsed * 1e9 / rounds);
+}
+
+int main()
+{
+    for (size_t size : {4 * 1024, 64 * 1024, 1024 * 1024}) {
+        std::string body = makeBody(size);
+        printf("body %zu bytes\n", size);
+        bench("gzip -1", body, ContentEncoding::GZIP, 1);
+        bench("gzip -6", body, ContentEncoding::GZIP, 6);
+        bench("gzip -9", body, ContentEncoding::GZIP, 9);
+        bench("deflate -6", body, ContentEncoding::DEFLATE, 6);
+        if (HasBrotli) bench("br static", body, ContentEncoding::BROTLI, 0);
+        benchCache(body, ContentEncoding::GZIP);
+    }
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "src/Server.h"
+
+using namespace cW;
+
+const unsigned short Port = 9002;
+
+std::atomic<size_t> received = 0;
+
+// a blocking handshake, the socket turns non blocking once upgraded
+int subscribe(size_t i)
+{
+    static const char request[] = "GET /feed HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\n"
+                                  "Connection: Upgrade\r\nSec-WebSocket-Version: 13\r\n"
+                                  "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    sockaddr_in addr{};
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(Port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd               = socket(AF_INET, SOCK_STREAM, 0);
+    // spread over loopback addresses, the kernel searches long for a free port on just one
+    sockaddr_in local{};
+    int         enabled   = 1;
+    local.sin_family      = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1 + i % 250);
+    setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &enabled, sizeof(enabled));
+    if (fd < 0 || bind(fd, (sockaddr*)&local, sizeof(local)) < 0 ||
+        connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0)
+        return -1;
+    send(fd, request, sizeof(request) - 1, 0);
+    std::string response;
+    char        buffer[512];
+    while (response.find("\r\n\r\n") == std::string::npos) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) return -1;
+        response.append(buffer, n);
+    }
+    if (response.compare(0, 12, "HTTP/1.1 101")) return -1;
+    int flags = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flags, sizeof(flags));
+    return fd;
+}
+
+// what the subscribers get is only counted, frames are all the same size
+void drain(int epoll)
+{
+    epoll_event events[256];
+    char        buffer[64 * 1024];
+    while (true) {
+        int n = epoll_wait(epoll, events, 256, -1);
+        for (int i = 0; i < n; i++) {
+            ssize_t bytes;
+            while ((bytes = recv(events[i].data.fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+                received += bytes;
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t wanted = argc > 1 ? atol(argv[1]) : 50000;
+    int    loops  = argc > 2 ? atoi(argv[2]) : std::thread::hardware_concurrency();
+
+    // both ends of every connection are in this process
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    size_t subscribers = std::min<size_t>(wanted, (limit.rlim_cur - 64) / 2);
+
+    static Server server;
+    server.open("/feed", [](WebSocket* ws) { ws->subscribe("ticker"); });
+    std::thread([loops] { server.listen(Port).run(MTMode::MULTIPLE_LISTENER, loops); }).detach();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    int epoll = epoll_create1(0);
+    for (size_t i = 0; i < subscribers; i++) {
+        int fd = subscribe(i);
+        if (fd < 0) {
+            printf("subscriber %zu failed to connect\n", i);
+            _exit(1);
+        }
+        epoll_event event{};
+        event.events  = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+    }
+    std::thread(drain, epoll).detach();
+    printf("%zu subscribers (%zu asked, fd limit %zu), %d loops\n", subscribers, wanted,
+           (size_t)limit.rlim_cur, loops);
+    printf("%10s %10s %14s %16s %12s %14s\n", "payload", "messages", "publish us/msg",
+           "deliveries/s", "MB/s", "us to deliver");
+
+    using namespace std::chrono;
+    const size_t messages = 100;
+    size_t       expected = 0;
+    for (size_t size : {16, 128, 1024, 16 * 1024}) {
+        std::string payload(size, 'x');
+        size_t      frameSize = 2 + size + (size > 125 ? (size > UINT16_MAX ? 8 : 2) : 0);
+        expected += subscribers * messages * frameSize;
+
+        auto start = steady_clock::now();
+        for (size_t i = 0; i < messages; i++)
+            server.publish("ticker", payload);
+        double publishing = duration<double>(steady_clock::now() - start).count();
+        while (received < expected)
+            std::this_thread::sleep_for(microseconds(50));
+        double elapsed = duration<double>(steady_clock::now() - start).count();
+
+        printf("%10zu %10zu %14.2f %16.0f %12.1f %14.0f\n", size, messages,
+               publishing / messages * 1e6, subscribers * messages / elapsed,
+               subscribers * messages * frameSize / elapsed / (1024 * 1024),
+               elapsed / messages * 1e6);
+    }
+    // the loops never return, nothing left to tear down
+    _exit(0);
+}
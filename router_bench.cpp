@@ -0,0 +1,113 @@
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include "src/Router.h"
+#include "src/UrlPath.h"
+
+using namespace cW;
+
+struct Table {
+    // patterns are viewed by the routes, so they must not move
+    std::vector<std::string>                        patterns;
+    std::vector<std::pair<HttpMethod, UrlPath>>     linear;
+    std::vector<std::pair<HttpMethod, std::string>> paths;
+    Router                                          router;
+
+    explicit Table(size_t nRoutes)
+    {
+        patterns.reserve(nRoutes);
+        for (size_t i = 0; i < nRoutes; i++) {
+            std::string n      = std::to_string(i);
+            HttpMethod  method = i % 5 == 4 ? HttpMethod::POST : HttpMethod::GET;
+            switch (i % 4) {
+                case 0:
+                    patterns.push_back("/api/v1/items" + n + "/{d:id}");
+                    paths.push_back({method, "/api/v1/items" + n + "/" + std::to_string(i * 7)});
+                    break;
+                case 1:
+                    patterns.push_back("/api/v1/users" + n + "/{s:name}/posts");
+                    paths.push_back({method, "/api/v1/users" + n + "/someone/posts"});
+                    break;
+                case 2:
+                    patterns.push_back("/static" + n + "/*");
+                    paths.push_back({method, "/static" + n + "/css/site.css"});
+                    break;
+                case 3:
+                    patterns.push_back("/api/v2/geo" + n + "/{f:lat}/{f:lng}");
+                    paths.push_back({method, "/api/v2/geo" + n + "/51.5/0.12/"});
+                    break;
+            }
+            linear.push_back({method, UrlPath(patterns.back())});
+            router.addHttpHandler(patterns.back().c_str(), method,
+                                  [](HttpRequest*, HttpResponse*) {});
+        }
+    }
+
+    const UrlPath* scan(HttpMethod method, const std::string_view& path) const
+    {
+        for (auto& [routeMethod, urlPath] : linear)
+            if (routeMethod == method && urlPath == path) return &urlPath;
+        return nullptr;
+    }
+};
+
+bool samePattern(const UrlPath& a, const UrlPath& b)
+{
+    if (a.levels.size() != b.levels.size()) return false;
+    for (size_t i = 0; i < a.levels.size(); i++)
+        if (a.levels[i].type != b.levels[i].type || a.levels[i].val != b.levels[i].val)
+            return false;
+    return true;
+}
+
+// single thread, lookups spread over every route
+template <typename Lookup>
+void bench(const char* name, const Table& table, Lookup&& lookup)
+{
+    using namespace std::chrono;
+    std::mt19937          rng(42);
+    std::vector<uint32_t> order(1 << 16);
+    for (auto& index : order)
+        index = rng() % table.paths.size();
+
+    size_t found = 0, rounds = 0;
+    auto   start   = steady_clock::now();
+    double elapsed = 0;
+    while (elapsed < 0.5) {
+        for (uint32_t index : order) {
+            auto& [method, path] = table.paths[index];
+            found += lookup(method, path) != nullptr;
+        }
+        rounds += order.size();
+        elapsed = duration<double>(steady_clock::now() - start).count();
+    }
+    printf("%-20s %10.1f ns/lookup  %s\n", name, elapsed * 1e9 / rounds,
+           found == rounds ? "" : "MISSED");
+}
+
+int main()
+{
+    for (size_t nRoutes : {10, 100, 1000}) {
+        Table table(nRoutes);
+        // both have to land on the same pattern
+        for (auto& [method, path] : table.paths) {
+            const UrlPath* tree = table.router.find(method, path);
+            const UrlPath* scan = table.scan(method, path);
+            if (!tree || !scan || !samePattern(*tree, *scan)) {
+                printf("mismatch on %s\n", path.c_str());
+                return 1;
+            }
+        }
+
+        printf("%zu routes\n", nRoutes);
+        bench("radix tree", table, [&](HttpMethod method, const std::string& path) {
+            return table.router.find(method, path);
+        });
+        bench("linear scan", table, [&](HttpMethod method, const std::string& path) {
+            return table.scan(method, path);
+        });
+    }
+    return 0;
+}
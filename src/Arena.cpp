@@ -0,0 +1,95 @@
+#include "Arena.h"
+#include <cstdlib>
+#include <algorithm>
+
+namespace cW {
+
+const size_t Arena::DefaultBlockSize = 16 * 1024;
+const size_t Arena::MaxRetainedSize  = 1024 * 1024;
+
+Arena::Arena(size_t blockSize) : blockSize(blockSize), initialSize(blockSize) {}
+
+Arena::Block* Arena::newBlock(size_t minSize)
+{
+    size_t size  = std::max(blockSize, minSize);
+    Block* block = (Block*)malloc(sizeof(Block) + size);
+    if (!block) throw std::bad_alloc();
+    block->next = nullptr;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void* Arena::allocateSlow(size_t bytes, size_t alignment)
+{
+    // block payload starts max_align_t aligned, so over-reserving alignment is enough
+    Block* block = newBlock(bytes + alignment);
+    if (current)
+        current->next = block;
+    else
+        head = block;
+    current = block;
+    return alloc(bytes, alignment);
+}
+
+void* Arena::do_allocate(size_t bytes, size_t alignment) { return alloc(bytes, alignment); }
+
+bool Arena::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+void Arena::reset()
+{
+    if (!head) return;
+    if (head->next) {
+        // request overflowed the first block, size the next one to fit everything we used
+        size_t total = 0;
+        for (Block* block = head; block;) {
+            Block* next = block->next;
+            total += block->used;
+            free(block);
+            block = next;
+        }
+        blockSize = std::min(std::max(blockSize, total), MaxRetainedSize);
+        head = current = nullptr;
+    }
+    else if (blockSize > initialSize && head->used <= blockSize / 4) {
+        // an idle keep-alive connection mustn't hold on to what one upload needed
+        free(head);
+        head = current = nullptr;
+        blockSize      = std::max(initialSize, blockSize / 2);
+    }
+    else {
+        head->used = 0;
+        current    = head;
+    }
+}
+
+void Arena::rewind(const Mark& mark)
+{
+    Block* block = mark.block ? mark.block->next : head;
+    while (block) {
+        Block* next = block->next;
+        free(block);
+        block = next;
+    }
+    if (mark.block) {
+        mark.block->next = nullptr;
+        mark.block->used = mark.used;
+    }
+    else
+        head = nullptr;
+    current = mark.block;
+}
+
+Arena::~Arena()
+{
+    for (Block* block = head; block;) {
+        Block* next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+}; // namespace cW
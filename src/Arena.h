@@ -0,0 +1,105 @@
+#ifndef __CW_ARENA_H_
+#define __CW_ARENA_H_
+
+#include <cstddef>
+#include <cstring>
+#include <memory_resource>
+#include <new>
+#include <string_view>
+#include <utility>
+
+namespace cW {
+
+// bump-pointer allocator owned by a connection, everything allocated in one request is released
+// at once by reset(). deallocate is a no-op so it can back std::pmr containers directly.
+class Arena : public std::pmr::memory_resource {
+    struct alignas(std::max_align_t) Block {
+        Block* next;
+        size_t size;
+        size_t used;
+    };
+
+    static const size_t DefaultBlockSize;
+    static const size_t MaxRetainedSize;
+
+    // head is the retained block, current is where allocation happens
+    Block* head      = nullptr;
+    Block* current   = nullptr;
+    size_t blockSize = DefaultBlockSize;
+    // what blockSize shrinks back to once large requests stop coming
+    size_t initialSize = DefaultBlockSize;
+
+    Block* newBlock(size_t minSize);
+    void*  allocateSlow(size_t bytes, size_t alignment);
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void  do_deallocate(void*, size_t, size_t) override {}
+    bool  do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+  public:
+    // where allocation stood, for giving back a stretch of allocations without a full reset
+    struct Mark {
+        Block* block = nullptr;
+        size_t used  = 0;
+    };
+
+    Arena(size_t blockSize = DefaultBlockSize);
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    inline void* alloc(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+    template <typename T, typename... Args>
+    inline T* make(Args&&... args);
+
+    // runs the destructor, memory is reclaimed on reset
+    template <typename T>
+    static inline void destroy(T* ptr);
+
+    inline std::string_view copy(const std::string_view& str);
+
+    // frees everything allocated since the last reset, keeps one block around for the next request.
+    // a block grown for one large request halves on every reset that used little of it
+    void reset();
+    inline Mark mark() const { return Mark{current, current ? current->used : 0}; }
+    // frees everything allocated since mark was taken, what came before stays
+    void rewind(const Mark& mark);
+    ~Arena();
+};
+
+void* Arena::alloc(size_t bytes, size_t alignment)
+{
+    if (current) {
+        char*  base  = reinterpret_cast<char*>(current + 1);
+        size_t start = (current->used + alignment - 1) & ~(alignment - 1);
+        if (start + bytes <= current->size) {
+            current->used = start + bytes;
+            return base + start;
+        }
+    }
+    return allocateSlow(bytes, alignment);
+}
+
+template <typename T, typename... Args>
+T* Arena::make(Args&&... args)
+{
+    return new (alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+}
+
+template <typename T>
+void Arena::destroy(T* ptr)
+{
+    if (ptr) ptr->~T();
+}
+
+std::string_view Arena::copy(const std::string_view& str)
+{
+    char* dest = (char*)alloc(str.size() + 1, 1);
+    std::memcpy(dest, str.data(), str.size());
+    dest[str.size()] = '\0';
+    return std::string_view(dest, str.size());
+}
+
+}; // namespace cW
+
+#endif
@@ -0,0 +1,151 @@
+#include "BodyBuffer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "Utils.h"
+
+namespace cW {
+
+// spilled bodies are written in chunks of at least this size
+const size_t BodyBuffer::StagingSize = 256 * 1024;
+
+int BodyBuffer::openTempFile()
+{
+    const char* dir = getenv("TMPDIR");
+    if (!dir || !*dir) dir = "/tmp";
+#ifdef O_TMPFILE
+    int fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0) return fd;
+#endif
+    // filesystem without O_TMPFILE support, unlink right after creating
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/cw_body_XXXXXX", dir);
+    fd = mkostemp(path, O_CLOEXEC);
+    if (fd < 0) {
+        perror("Couldn't create body spill file");
+        return -1;
+    }
+    unlink(path);
+    return fd;
+}
+
+bool BodyBuffer::begin(size_t length, size_t memoryLimit)
+{
+    this->memoryLimit = memoryLimit;
+    if (length == __INF__) {
+        growable = true;
+        return true;
+    }
+    if (length <= memoryLimit) {
+        data     = (char*)malloc(std::max(length, (size_t)1));
+        capacity = length;
+        return data != nullptr;
+    }
+    return spill();
+}
+
+bool BodyBuffer::spill()
+{
+    if ((fd = openTempFile()) < 0) return false;
+    staging = (char*)malloc(StagingSize);
+    return staging != nullptr;
+}
+
+// doubles up to the memory limit, only a body that needs more than that spills
+bool BodyBuffer::grow(size_t needed)
+{
+    if (needed > memoryLimit) {
+        // what we have so far goes to the file first
+        if (!spill()) return false;
+        size_t buffered = size;
+        size            = 0;
+        bool ok         = append(std::string_view(data, buffered));
+        free(data);
+        data     = nullptr;
+        capacity = 0;
+        return ok;
+    }
+    size_t newCapacity = std::min(std::max({capacity * 2, needed, (size_t)4096}), memoryLimit);
+    // grows in place when it can, a moved buffer doesn't leave the old one behind
+    char* newData = (char*)realloc(data, newCapacity);
+    if (!newData) return false;
+    data     = newData;
+    capacity = newCapacity;
+    return true;
+}
+
+static bool writeAll(int fd, const char* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t wrote = ::write(fd, data, size);
+        if (wrote < 0) {
+            if (errno == EINTR) continue;
+            perror("Couldn't write body spill file");
+            return false;
+        }
+        data += wrote;
+        size -= wrote;
+    }
+    return true;
+}
+
+bool BodyBuffer::flushStaging()
+{
+    bool ok     = writeAll(fd, staging, stagingUsed);
+    stagingUsed = 0;
+    return ok;
+}
+
+bool BodyBuffer::append(const std::string_view& chunk)
+{
+    if (fd < 0 && growable && size + chunk.size() > capacity && !grow(size + chunk.size()))
+        return false;
+    if (fd < 0) {
+        size_t toCopy = std::min(chunk.size(), capacity - size);
+        std::memcpy(data + size, chunk.data(), toCopy);
+        size += toCopy;
+        return true;
+    }
+    size += chunk.size();
+    if (stagingUsed + chunk.size() > StagingSize && !flushStaging()) return false;
+    // big chunks go straight to the file, small ones are gathered first
+    if (chunk.size() >= StagingSize) return writeAll(fd, chunk.data(), chunk.size());
+    std::memcpy(staging + stagingUsed, chunk.data(), chunk.size());
+    stagingUsed += chunk.size();
+    return true;
+}
+
+std::string_view BodyBuffer::view()
+{
+    if (fd < 0) return std::string_view(data, size);
+    if (!mapped && size > 0) {
+        if (stagingUsed && !flushStaging()) return std::string_view();
+        free(staging);
+        staging = nullptr;
+        void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            perror("Couldn't map body spill file");
+            return std::string_view();
+        }
+        madvise(map, size, MADV_SEQUENTIAL);
+        mapped       = map;
+        mappedLength = size;
+    }
+    return std::string_view((const char*)mapped, mappedLength);
+}
+
+BodyBuffer::~BodyBuffer()
+{
+    if (mapped) munmap(mapped, mappedLength);
+    if (fd >= 0) close(fd);
+    free(staging);
+    free(data);
+}
+
+}; // namespace cW
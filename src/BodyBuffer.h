@@ -0,0 +1,56 @@
+#ifndef __CW_BODY_BUFFER_H_
+#define __CW_BODY_BUFFER_H_
+
+#include <cstddef>
+#include <string_view>
+
+namespace cW {
+
+// collects a request body. bodies that fit the memory limit are kept in a buffer of their own,
+// larger ones are written to an unlinked temp file and handed out as a read only mapping. neither
+// goes into the connection arena, which would keep the size of the largest upload.
+class BodyBuffer {
+    static const size_t StagingSize;
+
+    char*  data     = nullptr;
+    size_t size     = 0;
+    size_t capacity = 0;
+    // length wasn't known up front, memory grows up to the limit and then spills
+    bool   growable    = false;
+    size_t memoryLimit = 0;
+
+    // spill file state
+    int    fd           = -1;
+    char*  staging      = nullptr;
+    size_t stagingUsed  = 0;
+    void*  mapped       = nullptr;
+    size_t mappedLength = 0;
+
+    static int openTempFile();
+    bool       flushStaging();
+    bool       spill();
+    bool       grow(size_t needed);
+
+  public:
+    BodyBuffer() = default;
+    BodyBuffer(const BodyBuffer&) = delete;
+    BodyBuffer& operator=(const BodyBuffer&) = delete;
+
+    // sizes the buffer for the whole body, false if the temp file couldn't be created.
+    // __INF__ for a body of unknown length
+    bool begin(size_t length, size_t memoryLimit);
+    bool append(const std::string_view& chunk);
+    // the complete body, mapped from disk if it was spilled
+    std::string_view view();
+
+    inline size_t received() const { return size; }
+    inline bool   spilled() const { return fd >= 0; }
+    // temp file holding the body, -1 when the body is in memory
+    inline int file() const { return fd; }
+
+    ~BodyBuffer();
+};
+
+}; // namespace cW
+
+#endif
@@ -5,6 +5,7 @@
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
 #include <iostream>
+#include "Http2Session.h"
 #include "HttpSession.h"
 #include "WebSocketSession.h"
 
@@ -132,11 +133,30 @@ int ClientSocket::write(const std::string_view& data, bool final)
     return write(data.data(), data.size(), final, true);
 }
 
-ClientSocket::~ClientSocket()
+int ClientSocket::writev(const iovec* buffers, int count)
 {
-    if (currentSession) delete currentSession;
+    if (!writeBuffer.empty()) {
+        write(nullptr, 0, true);
+        if (!writeBuffer.empty()) return 0;
+    }
+    size_t total = 0;
+    for (int i = 0; i < count; i++)
+        total += buffers[i].iov_len;
+    // sendmsg rather than writev, a peer gone meanwhile mustn't raise SIGPIPE
+    msghdr message{};
+    message.msg_iov    = (iovec*)buffers;
+    message.msg_iovlen = count;
+    ssize_t wrote      = sendmsg(fd, &message, MSG_NOSIGNAL);
+    if (wrote < 0) {
+        if (errno != EAGAIN) perror("Write error");
+        wrote = 0;
+    }
+    wantWrite = (size_t)wrote < total;
+    return (int)wrote;
 }
 
+ClientSocket::~ClientSocket() { endSession(); }
+
 void ClientSocket::loopPreCb()
 {
     if (currentSession) { currentSession->onAwakePre(); }
@@ -146,8 +166,7 @@ void ClientSocket::loopPostCb()
 {
     if (currentSession) {
         if (currentSession->shouldEnd()) {
-            delete currentSession;
-            currentSession = nullptr;
+            endSession();
             writeBuffer.clear();
         }
         else
@@ -161,28 +180,39 @@ void ClientSocket::onData(const std::string_view& data)
 {
     if (currentSession)
         currentSession->onData(data);
+    else if (data.starts_with(Http2Session::Preface.substr(0, 4))) {
+        // http/2 with prior knowledge
+        currentSession = new (arena.alloc(sizeof(Http2Session), alignof(Http2Session)))
+            Http2Session(this);
+        currentSession->onData(data);
+    }
     else {
-        static const char* ws_match      = "upgrade: websocket";
-        static int         ws_match_size = (int)strlen(ws_match);
-        int                j             = 0;
-        size_t             headerEnd     = data.find("\r\n\r\n");
+        size_t headerEnd = data.find("\r\n\r\n");
         if (contains(data, "HTTP/") && headerEnd != std::string_view::npos) {
-            // naive linear string match since there's no repitition in match string
-            for (size_t i = 0; i < data.size(); i++) {
-                if (to_lower(data[i]) == ws_match[j]) {
-                    j++;
-                    if (j == ws_match_size) {
-                        currentSession = new WebSocketSession(this);
-                        wantWrite      = true;
-                        return;
-                    }
-                }
-                else {
-                    if (j != 0) i--; // match might start here
-                    j = 0;
-                }
+            std::string_view header = data.substr(0, headerEnd + 2);
+            if (ci_find<true>(header, "upgrade: websocket") != __INF__) {
+                currentSession =
+                    new (arena.alloc(sizeof(WebSocketSession), alignof(WebSocketSession)))
+                        WebSocketSession(this, header);
+                // frames sent before the 101 arrived
+                if (connected && data.size() > headerEnd + 4)
+                    currentSession->onData(data.substr(headerEnd + 4));
+                wantWrite = true;
+                return;
+            }
+            // h2c upgrade, only taken without a body since that would have to be read as http/1.1
+            if (ci_find<true>(header, "upgrade: h2c") != __INF__ &&
+                ci_find<true>(header, "http2-settings:") != __INF__ &&
+                (ci_find<true>(header, "content-length:") == __INF__ ||
+                 ci_find<true>(header, "content-length: 0\r\n") != __INF__)) {
+                currentSession = new (arena.alloc(sizeof(Http2Session), alignof(Http2Session)))
+                    Http2Session(this, header);
+                if (data.size() > headerEnd + 4) currentSession->onData(data.substr(headerEnd + 4));
+                wantWrite = true;
+                return;
             }
-            currentSession = new HttpSession(this, data.substr(0, headerEnd + 2));
+            currentSession = new (arena.alloc(sizeof(HttpSession), alignof(HttpSession)))
+                HttpSession(this, header);
             if (data.size() > headerEnd + 4) currentSession->onData(data.substr(headerEnd + 4));
             wantWrite = true;
         }
@@ -203,4 +233,14 @@ void ClientSocket::onAborted()
 }
 
 void ClientSocket::disconnect() { connected = false; }
+
+// sessions are placed in the arena so only the destructor runs here, the memory goes with reset
+void ClientSocket::endSession()
+{
+    if (currentSession) {
+        currentSession->~Session();
+        currentSession = nullptr;
+    }
+    arena.reset();
+}
 }; // namespace cW
\ No newline at end of file
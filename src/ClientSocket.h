@@ -6,6 +6,8 @@
 #include <string_view>
 #include <chrono>
 #include <mutex>
+#include <sys/uio.h>
+#include "Arena.h"
 #include "ListenSocket.h"
 #include "Session.h"
 
@@ -13,18 +15,25 @@ namespace cW {
 enum UpgradeSocket {
     DONT,
     HTTPSOCKET,
-    WEBSOCKET
-    // http2 or other protocols someday..
+    WEBSOCKET,
+    HTTP2SOCKET
 };
 
 class Session;
 class Server;
+class Poll;
 
 class ClientSocket : Socket {
 
     friend class Poll;
     friend class HttpSession;
+    friend class Http2Session;
     friend class WebSocketSession;
+    friend class SingleFlight;
+    friend class PubSub;
+
+    // a request waiting on another thread parks its socket until woken
+    enum Park : uint8_t { AWAKE, PARKING, PARKED, WOKEN };
 
     const Server* server;
 
@@ -39,12 +48,21 @@ class ClientSocket : Socket {
     bool wantRead  = true;
     bool wantWrite = false;
 
+    Poll*             poll   = nullptr;
+    std::atomic<Park> park   = AWAKE;
+    bool              waited = false;
+
+    // held while a shared poll serves it, publications can reach it from another thread
     std::mutex                   mtx;
     std::unique_lock<std::mutex> lock;
+    // removed from its poll, events fetched before that are ignored
+    bool closed = false;
 
     std::string ip;
     size_t      id;
 
+    // sessions and everything they allocate per request live here
+    Arena    arena;
     Session* currentSession = nullptr;
 
     std::string writeBuffer;
@@ -55,6 +73,9 @@ class ClientSocket : Socket {
     int write(const char* data, bool final = false);
     int write(const std::string& data, bool final = false);
     int write(const std::string_view& data, bool final = false);
+    // the buffers in one send once writeBuffer is out, nothing of them is kept. returns how much
+    // the socket took
+    int writev(const iovec* buffers, int count);
 
     ClientSocket(SOCKET fd, const char* ip, const Server* server, bool oneShot);
     ClientSocket(const ClientSocket&) = delete;
@@ -67,6 +88,7 @@ class ClientSocket : Socket {
     void onWritable();
     void onAborted();
     void disconnect();
+    void endSession();
 
     ~ClientSocket();
 };
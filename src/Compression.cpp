@@ -0,0 +1,336 @@
+#include "Compression.h"
+
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include "Utils.h"
+#ifdef CW_HAS_BROTLI
+#include <brotli/encode.h>
+#endif
+
+namespace cW {
+
+const size_t Deflater::MaxPooled        = 64;
+const size_t Inflater::MaxPooled        = 64;
+const size_t CompressionCache::MaxBytes = 64 * 1024 * 1024;
+
+const char* encodingName(ContentEncoding encoding)
+{
+    switch (encoding) {
+        case ContentEncoding::GZIP: return "gzip";
+        case ContentEncoding::DEFLATE: return "deflate";
+        case ContentEncoding::BROTLI: return "br";
+        default: return "identity";
+    }
+}
+
+ContentEncoding negotiateEncoding(const std::string_view& acceptEncoding, bool allowBrotli)
+{
+    // -1 means not listed
+    float  quality[4] = {-1, -1, -1, -1};
+    float  any        = -1;
+    size_t len        = acceptEncoding.size();
+    for (size_t i = 0; i < len;) {
+        size_t           next  = std::min(acceptEncoding.find(',', i), len);
+        std::string_view item  = acceptEncoding.substr(i, next - i);
+        size_t           semi  = item.find(';');
+        std::string_view name  = item.substr(0, semi);
+        float            value = 1;
+        i                      = next + 1;
+        if (semi != std::string_view::npos) {
+            size_t q = item.find("q=", semi);
+            if (q != std::string_view::npos) value = strtof(item.data() + q + 2, nullptr);
+        }
+        while (!name.empty() && name.front() == ' ')
+            name.remove_prefix(1);
+        while (!name.empty() && name.back() == ' ')
+            name.remove_suffix(1);
+        if (ci_match<true>(name, "gzip") || ci_match<true>(name, "x-gzip"))
+            quality[(int)ContentEncoding::GZIP] = value;
+        else if (ci_match<true>(name, "deflate"))
+            quality[(int)ContentEncoding::DEFLATE] = value;
+        else if (ci_match<true>(name, "br"))
+            quality[(int)ContentEncoding::BROTLI] = value;
+        else if (name == "*")
+            any = value;
+    }
+    // on equal quality the earlier one wins
+    static const ContentEncoding preference[] = {
+        ContentEncoding::BROTLI, ContentEncoding::GZIP, ContentEncoding::DEFLATE};
+    ContentEncoding best        = ContentEncoding::IDENTITY;
+    float           bestQuality = 0;
+    for (auto encoding : preference) {
+        if (encoding == ContentEncoding::BROTLI && !allowBrotli) continue;
+        float value = quality[(int)encoding] >= 0 ? quality[(int)encoding] : any;
+        if (value > bestQuality) {
+            best        = encoding;
+            bestQuality = value;
+        }
+    }
+    return best;
+}
+
+namespace {
+struct DeflaterPool {
+    std::vector<Deflater*> free[2];
+    ~DeflaterPool()
+    {
+        for (auto& list : free)
+            for (auto deflater : list)
+                delete deflater;
+    }
+};
+thread_local DeflaterPool deflaterPool;
+
+inline int poolIndex(ContentEncoding encoding) { return encoding == ContentEncoding::GZIP ? 0 : 1; }
+} // namespace
+
+Deflater::Deflater(ContentEncoding encoding, int level) : encoding(encoding), level(level)
+{
+    std::memset(&stream, 0, sizeof(stream));
+    // 31 adds the gzip wrapper, 15 is zlib format which is what "deflate" means over http
+    int windowBits = encoding == ContentEncoding::GZIP ? 31 : 15;
+    if (deflateInit2(&stream, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        throw std::runtime_error("Couldn't initialize deflate stream");
+}
+
+Deflater* Deflater::acquire(ContentEncoding encoding, int level)
+{
+    assert((encoding == ContentEncoding::GZIP || encoding == ContentEncoding::DEFLATE) &&
+           "Deflater only produces gzip and deflate");
+    auto& list = deflaterPool.free[poolIndex(encoding)];
+    if (list.empty()) return new Deflater(encoding, level);
+    Deflater* deflater = list.back();
+    list.pop_back();
+    if (deflater->level != level) {
+        deflateParams(&deflater->stream, level, Z_DEFAULT_STRATEGY);
+        deflater->level = level;
+    }
+    return deflater;
+}
+
+void Deflater::release(Deflater* deflater)
+{
+    if (!deflater) return;
+    auto& list = deflaterPool.free[poolIndex(deflater->encoding)];
+    if (list.size() >= MaxPooled) {
+        delete deflater;
+        return;
+    }
+    deflateReset(&deflater->stream);
+    list.push_back(deflater);
+}
+
+std::pair<size_t, size_t> Deflater::compress(const std::string_view& in,
+                                             char*                   out,
+                                             size_t                  outSize,
+                                             int                     flush)
+{
+    stream.next_in   = (Bytef*)in.data();
+    stream.avail_in  = (uInt)in.size();
+    stream.next_out  = (Bytef*)out;
+    stream.avail_out = (uInt)outSize;
+    deflate(&stream, flush);
+    return {in.size() - stream.avail_in, outSize - stream.avail_out};
+}
+
+Deflater::~Deflater() { deflateEnd(&stream); }
+
+namespace {
+struct InflaterPool {
+    std::vector<Inflater*> free;
+    ~InflaterPool()
+    {
+        for (auto inflater : free)
+            delete inflater;
+    }
+};
+thread_local InflaterPool inflaterPool;
+} // namespace
+
+Inflater::Inflater()
+{
+    std::memset(&stream, 0, sizeof(stream));
+    // 32 turns on gzip/zlib header detection
+    if (inflateInit2(&stream, 32 + 15) != Z_OK)
+        throw std::runtime_error("Couldn't initialize inflate stream");
+}
+
+Inflater* Inflater::acquire()
+{
+    auto& list = inflaterPool.free;
+    if (list.empty()) return new Inflater();
+    Inflater* inflater = list.back();
+    list.pop_back();
+    return inflater;
+}
+
+void Inflater::release(Inflater* inflater)
+{
+    if (!inflater) return;
+    auto& list = inflaterPool.free;
+    if (list.size() >= MaxPooled) {
+        delete inflater;
+        return;
+    }
+    inflateReset(&inflater->stream);
+    inflater->finished = false;
+    list.push_back(inflater);
+}
+
+std::pair<size_t, size_t> Inflater::inflate(const std::string_view& in, char* out, size_t outSize)
+{
+    stream.next_in   = (Bytef*)in.data();
+    stream.avail_in  = (uInt)in.size();
+    stream.next_out  = (Bytef*)out;
+    stream.avail_out = (uInt)outSize;
+    int ret          = ::inflate(&stream, Z_NO_FLUSH);
+    if (ret == Z_STREAM_END)
+        finished = true;
+    else if (ret != Z_OK && ret != Z_BUF_ERROR)
+        throw std::runtime_error("Corrupt compressed body");
+    return {in.size() - stream.avail_in, outSize - stream.avail_out};
+}
+
+Inflater::~Inflater() { inflateEnd(&stream); }
+
+bool parseContentEncoding(const std::string_view& contentEncoding, ContentEncoding& encoding)
+{
+    if (contentEncoding.empty() || ci_match<true>(contentEncoding, "identity"))
+        encoding = ContentEncoding::IDENTITY;
+    else if (ci_match<true>(contentEncoding, "gzip") || ci_match<true>(contentEncoding, "x-gzip"))
+        encoding = ContentEncoding::GZIP;
+    else if (ci_match<true>(contentEncoding, "deflate"))
+        encoding = ContentEncoding::DEFLATE;
+    else
+        return false;
+    return true;
+}
+
+std::string compress(const std::string_view& data, ContentEncoding encoding, int level)
+{
+    std::string out;
+    switch (encoding) {
+        case ContentEncoding::GZIP:
+        case ContentEncoding::DEFLATE: {
+            Deflater* deflater = Deflater::acquire(encoding, level);
+            out.resize(deflater->bound(data.size()));
+            auto [consumed, produced] = deflater->compress(data, out.data(), out.size(), Z_FINISH);
+            out.resize(produced);
+            Deflater::release(deflater);
+            break;
+        }
+        case ContentEncoding::BROTLI: {
+#ifdef CW_HAS_BROTLI
+            size_t size = BrotliEncoderMaxCompressedSize(data.size());
+            out.resize(size);
+            if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY,
+                                       BROTLI_DEFAULT_WINDOW,
+                                       BROTLI_MODE_GENERIC,
+                                       data.size(),
+                                       (const uint8_t*)data.data(),
+                                       &size,
+                                       (uint8_t*)out.data()))
+                throw std::runtime_error("Brotli compression failed");
+            out.resize(size);
+            break;
+#endif
+        }
+        default: out = data;
+    }
+    // sized for the worst case until here, cached bodies would keep all of it
+    out.shrink_to_fit();
+    return out;
+}
+
+namespace {
+struct CacheKey {
+    size_t          hash;
+    size_t          size;
+    ContentEncoding encoding;
+    int             level;
+    bool            operator==(const CacheKey& other) const = default;
+};
+struct CacheKeyHash {
+    size_t operator()(const CacheKey& key) const
+    {
+        return key.hash ^ (key.size * 31) ^ ((size_t)key.encoding << 3) ^ ((size_t)key.level << 7);
+    }
+};
+struct CacheSlot {
+    CompressionCache::Entry entry;
+    // what was compressed, a hit has to be the same bytes and not just the same hash
+    std::string source;
+    // the miss count when it was last hit, the lowest goes first
+    std::atomic<uint64_t> used;
+
+    CacheSlot(const CompressionCache::Entry& entry, const std::string_view& source, uint64_t used)
+        : entry(entry), source(source), used(used)
+    {
+    }
+    size_t bytes() const { return entry->size() + source.size(); }
+};
+struct CacheShard {
+    std::shared_mutex                                       mtx;
+    std::unordered_map<CacheKey, CacheSlot, CacheKeyHash> entries;
+    size_t                                                  bytes = 0;
+};
+const size_t shardCount = 16;
+CacheShard   shards[shardCount];
+// hits only read it, the recency of a hit is stamped without a shared write
+std::atomic<uint64_t> misses = 0;
+} // namespace
+
+CompressionCache::Entry CompressionCache::get(const std::string_view& body,
+                                              ContentEncoding         encoding,
+                                              int                     level)
+{
+    const size_t shardBytes = MaxBytes / shardCount;
+    if (body.size() > shardBytes / 2) return nullptr;
+    CacheKey    key{std::hash<std::string_view>()(body), body.size(), encoding, level};
+    CacheShard& shard = shards[CacheKeyHash()(key) % shardCount];
+    {
+        std::shared_lock lock(shard.mtx);
+        if (auto itr = shard.entries.find(key);
+            itr != shard.entries.end() && itr->second.source == body) {
+            uint64_t now = misses.load(std::memory_order_relaxed);
+            if (itr->second.used.load(std::memory_order_relaxed) != now)
+                itr->second.used.store(now, std::memory_order_relaxed);
+            return itr->second.entry;
+        }
+    }
+    // compress outside the lock, a concurrent miss just does the work twice
+    auto     entry = std::make_shared<const std::string>(compress(body, encoding, level));
+    uint64_t now   = misses.fetch_add(1, std::memory_order_relaxed) + 1;
+    std::unique_lock lock(shard.mtx);
+    auto [itr, inserted] = shard.entries.try_emplace(key, entry, body, now);
+    if (!inserted) {
+        if (itr->second.source == body) return itr->second.entry;
+        // another body with the same hash, the newer one takes the slot
+        shard.bytes -= itr->second.bytes();
+        shard.entries.erase(itr);
+        itr = shard.entries.try_emplace(key, entry, body, now).first;
+    }
+    shard.bytes += itr->second.bytes();
+    // misses are rare next to hits and cost a compression, a scan of the shard is nothing to that
+    while (shard.bytes > shardBytes) {
+        auto oldest = shard.entries.end();
+        for (auto it = shard.entries.begin(); it != shard.entries.end(); it++)
+            if (it != itr && (oldest == shard.entries.end() ||
+                              it->second.used.load(std::memory_order_relaxed) <
+                                  oldest->second.used.load(std::memory_order_relaxed)))
+                oldest = it;
+        // an incompressible body can come out a little over the limit by itself
+        if (oldest == shard.entries.end()) break;
+        shard.bytes -= oldest->second.bytes();
+        shard.entries.erase(oldest);
+    }
+    return entry;
+}
+
+}; // namespace cW
@@ -0,0 +1,97 @@
+#ifndef __CW_COMPRESSION_H_
+#define __CW_COMPRESSION_H_
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <zlib.h>
+
+namespace cW {
+
+enum class ContentEncoding { IDENTITY, GZIP, DEFLATE, BROTLI };
+
+#ifdef CW_HAS_BROTLI
+constexpr bool HasBrotli = true;
+#else
+constexpr bool HasBrotli = false;
+#endif
+
+const char* encodingName(ContentEncoding encoding);
+
+// best encoding allowed by an accept-encoding header, brotli is only picked when allowed
+ContentEncoding negotiateEncoding(const std::string_view& acceptEncoding, bool allowBrotli = false);
+
+// gzip/deflate stream kept in a per loop pool, reused with deflateReset instead of set up for
+// every response
+class Deflater {
+    static const size_t MaxPooled;
+
+    z_stream        stream;
+    ContentEncoding encoding;
+    int             level;
+
+    Deflater(ContentEncoding encoding, int level);
+
+  public:
+    static Deflater* acquire(ContentEncoding encoding, int level);
+    static void      release(Deflater* deflater);
+
+    // upper bound for compressing size bytes in one go
+    inline size_t bound(size_t size) { return deflateBound(&stream, size); }
+
+    // compresses as much of in as fits into out, flush is a zlib flush mode.
+    // returns [consumed, produced]
+    std::pair<size_t, size_t> compress(const std::string_view& in,
+                                       char*                   out,
+                                       size_t                  outSize,
+                                       int                     flush);
+
+    ~Deflater();
+};
+
+// inflate stream for gzip/deflate request bodies, pooled per loop like Deflater. either wrapper
+// is detected from the stream header
+class Inflater {
+    static const size_t MaxPooled;
+
+    z_stream stream;
+    bool     finished = false;
+
+    Inflater();
+
+  public:
+    static Inflater* acquire();
+    static void      release(Inflater* inflater);
+
+    // inflates as much of in as fits into out, throws on corrupt data.
+    // returns [consumed, produced]
+    std::pair<size_t, size_t> inflate(const std::string_view& in, char* out, size_t outSize);
+    // end of the compressed stream was reached
+    inline bool done() const { return finished; }
+
+    ~Inflater();
+};
+
+// encoding named by a content-encoding header, false if we can't decode it
+bool parseContentEncoding(const std::string_view& contentEncoding, ContentEncoding& encoding);
+
+// compresses a whole buffer into a new string
+std::string compress(const std::string_view& data, ContentEncoding encoding, int level);
+
+// precompressed bodies for responses whose bytes never change. keyed by content and compared
+// byte for byte on a hit, so neither a reused buffer nor a hash collision gets another's bytes
+class CompressionCache {
+  public:
+    typedef std::shared_ptr<const std::string> Entry;
+
+    // split evenly over the shards, each evicts its least recently used entries to stay in its
+    // part. the copy of each body counts too, one larger than half a part is never compressed
+    static const size_t MaxBytes;
+
+    // null when the body is too large to keep, it goes out uncompressed then
+    static Entry get(const std::string_view& body, ContentEncoding encoding, int level);
+};
+
+}; // namespace cW
+
+#endif
@@ -0,0 +1,116 @@
+#include "Conditional.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+
+namespace cW {
+
+namespace {
+inline std::string_view trim(std::string_view str)
+{
+    while (!str.empty() && (str.front() == ' ' || str.front() == '\t'))
+        str.remove_prefix(1);
+    while (!str.empty() && (str.back() == ' ' || str.back() == '\t'))
+        str.remove_suffix(1);
+    return str;
+}
+
+inline bool isWeak(const std::string_view& tag) { return tag.starts_with("W/"); }
+inline std::string_view opaque(const std::string_view& tag)
+{
+    return isWeak(tag) ? tag.substr(2) : tag;
+}
+} // namespace
+
+bool etagMatches(std::string_view list, const std::string_view& etag, bool weak)
+{
+    if (trim(list) == "*") return true;
+    if (etag.empty() || (!weak && isWeak(etag))) return false;
+    while (!list.empty()) {
+        size_t           comma = list.find(',');
+        std::string_view tag   = trim(list.substr(0, comma));
+        list.remove_prefix(comma == std::string_view::npos ? list.size() : comma + 1);
+        if (!weak && isWeak(tag)) continue;
+        if (opaque(tag) == opaque(etag)) return true;
+    }
+    return false;
+}
+
+std::string_view formatHttpDate(time_t time, char* buffer)
+{
+    tm parts;
+    gmtime_r(&time, &parts);
+    return std::string_view(buffer,
+                            strftime(buffer, 30, "%a, %d %b %Y %H:%M:%S GMT", &parts));
+}
+
+bool parseHttpDate(const std::string_view& date, time_t& time)
+{
+    // strptime wants a terminated string
+    char buffer[64];
+    if (date.size() >= sizeof(buffer)) return false;
+    std::memcpy(buffer, date.data(), date.size());
+    buffer[date.size()] = '\0';
+    tm          parts{};
+    const char* end = strptime(buffer, "%a, %d %b %Y %H:%M:%S GMT", &parts);
+    if (!end || *end) return false;
+    time = timegm(&parts);
+    return true;
+}
+
+bool parseRange(std::string_view header, size_t size, std::pmr::vector<ByteRange>& ranges)
+{
+    header = trim(header);
+    if (!header.starts_with("bytes=")) return false;
+    header.remove_prefix(6);
+    size_t count = 0;
+    while (!header.empty()) {
+        size_t           comma = header.find(',');
+        std::string_view spec  = trim(header.substr(0, comma));
+        header.remove_prefix(comma == std::string_view::npos ? header.size() : comma + 1);
+        if (spec.empty()) continue;
+        if (++count > MaxByteRanges) return false;
+        size_t dash = spec.find('-');
+        if (dash == std::string_view::npos) return false;
+        std::string_view firstPart = trim(spec.substr(0, dash));
+        std::string_view lastPart  = trim(spec.substr(dash + 1));
+        size_t           first = 0, last = size - 1;
+        if (firstPart.empty()) {
+            // suffix range, the last n bytes
+            size_t suffix;
+            auto [end, ec] =
+                std::from_chars(lastPart.data(), lastPart.data() + lastPart.size(), suffix);
+            if (ec != std::errc() || end != lastPart.data() + lastPart.size()) return false;
+            if (suffix == 0 || size == 0) continue;
+            first = suffix >= size ? 0 : size - suffix;
+        }
+        else {
+            auto [end, ec] =
+                std::from_chars(firstPart.data(), firstPart.data() + firstPart.size(), first);
+            if (ec != std::errc() || end != firstPart.data() + firstPart.size()) return false;
+            if (!lastPart.empty()) {
+                auto [end, ec] =
+                    std::from_chars(lastPart.data(), lastPart.data() + lastPart.size(), last);
+                if (ec != std::errc() || end != lastPart.data() + lastPart.size() || last < first)
+                    return false;
+                last = std::min(last, size - 1);
+            }
+            // unsatisfiable ranges are dropped, the rest can still be served
+            if (first >= size) continue;
+        }
+        ranges.push_back({first, last});
+    }
+    return count > 0;
+}
+
+std::string_view strongETag(const std::string_view& body, char* buffer)
+{
+    size_t hash = std::hash<std::string_view>()(body);
+    int    len  = snprintf(buffer, 40, "\"%zx-%zx\"", hash, body.size());
+    return std::string_view(buffer, len);
+}
+
+}; // namespace cW
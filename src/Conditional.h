@@ -0,0 +1,36 @@
+#ifndef __CW_CONDITIONAL_H_
+#define __CW_CONDITIONAL_H_
+
+#include <ctime>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+namespace cW {
+
+// more ranges than this in one request are ignored and the whole body is sent
+inline constexpr size_t MaxByteRanges = 16;
+
+// inclusive byte offsets into the selected representation
+struct ByteRange {
+    size_t first;
+    size_t last;
+};
+
+// RFC 9110 entity tag comparison against a comma separated list, "*" matches anything
+bool etagMatches(std::string_view list, const std::string_view& etag, bool weak);
+
+// IMF-fixdate, buffer must hold 30 bytes
+std::string_view formatHttpDate(time_t time, char* buffer);
+bool             parseHttpDate(const std::string_view& date, time_t& time);
+
+// Range header against a representation of size bytes. false if the header should be ignored,
+// an empty result means nothing was satisfiable
+bool parseRange(std::string_view header, size_t size, std::pmr::vector<ByteRange>& ranges);
+
+// quoted strong ETag from the content and size of body, buffer must hold 40 bytes
+std::string_view strongETag(const std::string_view& body, char* buffer);
+
+}; // namespace cW
+
+#endif
@@ -0,0 +1,49 @@
+#include "FrameBuffer.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace cW {
+
+FrameBuffer* FrameBuffer::allocate(WsOpcode opcode, size_t payloadLength, bool fin, bool compressed)
+{
+    uint8_t header[10];
+    size_t  headerLength = 2;
+    // opcode enum values are the ones on the wire
+    header[0] = (fin ? 0x80 : 0) | (compressed ? 0x40 : 0) | (uint8_t)opcode;
+    if (payloadLength <= 125)
+        header[1] = (uint8_t)payloadLength;
+    else {
+        size_t extended = payloadLength <= UINT16_MAX ? 2 : 8;
+        header[1]       = extended == 2 ? 126 : 127;
+        for (size_t i = 0; i < extended; i++)
+            header[2 + i] = (uint8_t)(payloadLength >> (8 * (extended - i - 1)));
+        headerLength += extended;
+    }
+
+    void* memory = malloc(sizeof(FrameBuffer) + headerLength + payloadLength);
+    if (!memory) throw std::bad_alloc();
+    auto* frame = new (memory) FrameBuffer(opcode, headerLength + payloadLength);
+    std::memcpy(frame->data(), header, headerLength);
+    return frame;
+}
+
+FrameBuffer* FrameBuffer::format(WsOpcode    opcode,
+                                 const char* payload,
+                                 size_t      payloadLength,
+                                 bool        fin,
+                                 bool        compressed)
+{
+    FrameBuffer* frame = allocate(opcode, payloadLength, fin, compressed);
+    std::memcpy(frame->data() + frame->size - payloadLength, payload, payloadLength);
+    return frame;
+}
+
+void FrameBuffer::destroy(FrameBuffer* frame)
+{
+    frame->~FrameBuffer();
+    free(frame);
+}
+
+}; // namespace cW
@@ -0,0 +1,84 @@
+#ifndef __CW_FRAME_BUFFER_H_
+#define __CW_FRAME_BUFFER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include "WebSocket.h"
+
+namespace cW {
+
+// an outgoing websocket frame, header and payload in one allocation. refcounted so a published
+// message is framed once and queued on every subscriber as it is
+struct FrameBuffer {
+    std::atomic<uint32_t> refs = 1;
+    // of the message, so a close frame can be told once it is written
+    WsOpcode opcode;
+    size_t   size;
+
+    inline char* data() const { return (char*)(this + 1); }
+    // what follows the header
+    inline std::string_view payload() const
+    {
+        uint8_t length       = (uint8_t)data()[1] & 0x7f;
+        size_t  headerLength = length < 126 ? 2 : length == 126 ? 4 : 10;
+        return std::string_view(data() + headerLength, size - headerLength);
+    }
+
+    // header written, the payload left for the caller to fill in place
+    static FrameBuffer* allocate(WsOpcode opcode,
+                                 size_t   payloadLength,
+                                 bool     fin        = true,
+                                 bool     compressed = false);
+    // server frames aren't masked, compressed marks the first frame of a message with rsv1
+    static FrameBuffer* format(WsOpcode    opcode,
+                               const char* payload,
+                               size_t      payloadLength,
+                               bool        fin        = true,
+                               bool        compressed = false);
+
+    inline FrameBuffer* retain()
+    {
+        refs.fetch_add(1, std::memory_order_relaxed);
+        return this;
+    }
+    inline void release()
+    {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) destroy(this);
+    }
+
+  private:
+    FrameBuffer(WsOpcode opcode, size_t size) : opcode(opcode), size(size) {}
+    static void destroy(FrameBuffer* frame);
+};
+
+// a message framed once, to send to any number of websockets or publish. copies share the frame
+class WsSharedMessage {
+    friend class WebSocket;
+    friend class Server;
+
+    FrameBuffer* frame;
+
+  public:
+    WsSharedMessage(WsOpcode opcode, const std::string_view& payload)
+        : frame(FrameBuffer::format(opcode, payload.data(), payload.size()))
+    {
+    }
+    WsSharedMessage(const WsSharedMessage& other) : frame(other.frame->retain()) {}
+    WsSharedMessage& operator=(const WsSharedMessage& other)
+    {
+        other.frame->retain();
+        frame->release();
+        frame = other.frame;
+        return *this;
+    }
+    ~WsSharedMessage() { frame->release(); }
+
+    inline WsOpcode         opcode() const { return frame->opcode; }
+    inline std::string_view data() const { return frame->payload(); }
+};
+
+}; // namespace cW
+
+#endif
@@ -0,0 +1,404 @@
+#include "Hpack.h"
+
+#include <stdexcept>
+
+namespace cW {
+
+const size_t HpackDecoder::EntryOverhead = 32;
+
+namespace {
+
+// RFC 7541 appendix A
+constexpr HpackHeader staticTable[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+constexpr size_t staticTableSize = sizeof(staticTable) / sizeof(staticTable[0]);
+
+// RFC 7541 appendix B, EOS is left out since it never appears in a valid string
+constexpr uint32_t huffmanCodes[256] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5,
+    0xfffffe6, 0xfffffe7, 0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9,
+    0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec, 0xfffffed, 0xfffffee,
+    0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9,
+    0xffffffa, 0xffffffb, 0x14, 0x3f8, 0x3f9, 0xffa,
+    0x1ff9, 0x15, 0xf8, 0x7fa, 0x3fa, 0x3fb,
+    0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b,
+    0x1c, 0x1d, 0x1e, 0x1f, 0x5c, 0xfb,
+    0x7ffc, 0x20, 0xffb, 0x3fc, 0x1ffa, 0x21,
+    0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e,
+    0x6f, 0x70, 0x71, 0x72, 0xfc, 0x73,
+    0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5,
+    0x25, 0x26, 0x27, 0x6, 0x74, 0x75,
+    0x28, 0x29, 0x2a, 0x7, 0x2b, 0x76,
+    0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd,
+    0x1ffd, 0xffffffc, 0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8,
+    0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9, 0x3fffd6, 0x7fffda,
+    0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1,
+    0x7fffe2, 0x7fffe3, 0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5,
+    0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef, 0x3fffda, 0x1fffdd,
+    0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf,
+    0x7fffeb, 0x7fffec, 0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2,
+    0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef, 0xfffea, 0x3fffe2,
+    0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2,
+    0x3fffe8, 0x1ffffec, 0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde,
+    0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed, 0x7fff2, 0x1fffe3,
+    0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3,
+    0x7ffffe4, 0x7ffffe5, 0xfffec, 0xfffff3, 0xfffed, 0x1fffe6,
+    0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3, 0x3fffea, 0x3fffeb,
+    0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8,
+    0x7ffffe9, 0x7ffffea, 0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed,
+    0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+};
+constexpr uint8_t huffmanLengths[256] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+};
+
+// the code is canonical, so codes of one length are consecutive and sorted like their symbols
+struct HuffmanDecodeTable {
+    uint32_t first[31];
+    uint16_t count[31];
+    uint16_t offset[31];
+    uint8_t  symbols[256];
+};
+
+constexpr HuffmanDecodeTable buildDecodeTable()
+{
+    HuffmanDecodeTable table{};
+    int                n = 0;
+    for (int len = 1; len <= 30; len++) {
+        table.offset[len] = n;
+        for (int symbol = 0; symbol < 256; symbol++) {
+            if (huffmanLengths[symbol] != len) continue;
+            if (table.count[len]++ == 0) table.first[len] = huffmanCodes[symbol];
+            table.symbols[n++] = symbol;
+        }
+    }
+    return table;
+}
+constexpr HuffmanDecodeTable decodeTable = buildDecodeTable();
+
+uint64_t decodeInt(std::string_view& in, int prefixBits)
+{
+    if (in.empty()) throw std::runtime_error("Truncated HPACK integer");
+    uint64_t max   = (1u << prefixBits) - 1;
+    uint64_t value = (uint8_t)in[0] & max;
+    in.remove_prefix(1);
+    if (value < max) return value;
+    for (int shift = 0; shift <= 56; shift += 7) {
+        if (in.empty()) break;
+        uint8_t byte = in[0];
+        in.remove_prefix(1);
+        value += (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+    throw std::runtime_error("Invalid HPACK integer");
+}
+
+// plain strings stay views into the block, huffman ones are decoded into the arena
+std::string_view decodeString(std::string_view& in, Arena& arena)
+{
+    if (in.empty()) throw std::runtime_error("Truncated HPACK string");
+    bool     huffman = in[0] & 0x80;
+    uint64_t len     = decodeInt(in, 7);
+    if (len > in.size()) throw std::runtime_error("Truncated HPACK string");
+    std::string_view raw = in.substr(0, len);
+    in.remove_prefix(len);
+    if (!huffman) return raw;
+    // shortest code is 5 bits
+    char*  out = (char*)arena.alloc(len * 8 / 5 + 1, 1);
+    size_t outLength;
+    if (!Huffman::decode(raw, out, outLength)) throw std::runtime_error("Invalid huffman string");
+    return std::string_view(out, outLength);
+}
+
+void encodeInt(std::string& out, uint8_t flags, int prefixBits, uint64_t value)
+{
+    uint64_t max = (1u << prefixBits) - 1;
+    if (value < max) {
+        out += (char)(flags | value);
+        return;
+    }
+    out += (char)(flags | max);
+    value -= max;
+    while (value >= 0x80) {
+        out += (char)(0x80 | (value & 0x7f));
+        value >>= 7;
+    }
+    out += (char)value;
+}
+
+void encodeString(std::string& out, const std::string_view& str)
+{
+    size_t huffmanLength = Huffman::encodedLength(str);
+    if (huffmanLength < str.size()) {
+        encodeInt(out, 0x80, 7, huffmanLength);
+        Huffman::encode(str, out);
+    }
+    else {
+        encodeInt(out, 0, 7, str.size());
+        out += str;
+    }
+}
+} // namespace
+
+bool Huffman::decode(const std::string_view& in, char* out, size_t& outLength)
+{
+    uint32_t code = 0;
+    int      len  = 0;
+    outLength     = 0;
+    for (unsigned char byte : in) {
+        for (int bit = 7; bit >= 0; bit--) {
+            code = (code << 1) | ((byte >> bit) & 1);
+            len++;
+            if (code - decodeTable.first[len] < decodeTable.count[len]) {
+                out[outLength++] = decodeTable.symbols[decodeTable.offset[len] + code -
+                                                       decodeTable.first[len]];
+                code = 0;
+                len  = 0;
+            }
+            else if (len == 30)
+                return false;
+        }
+    }
+    // padding is a prefix of EOS, all ones and shorter than a byte
+    return len < 8 && code == (1u << len) - 1;
+}
+
+size_t Huffman::encodedLength(const std::string_view& in)
+{
+    size_t bits = 0;
+    for (unsigned char c : in)
+        bits += huffmanLengths[c];
+    return (bits + 7) / 8;
+}
+
+void Huffman::encode(const std::string_view& in, std::string& out)
+{
+    uint64_t bits  = 0;
+    int      nBits = 0;
+    for (unsigned char c : in) {
+        bits = (bits << huffmanLengths[c]) | huffmanCodes[c];
+        nBits += huffmanLengths[c];
+        while (nBits >= 8) {
+            nBits -= 8;
+            out += (char)(bits >> nBits);
+        }
+        bits &= (1ull << nBits) - 1;
+    }
+    if (nBits > 0) out += (char)((bits << (8 - nBits)) | (0xff >> nBits));
+}
+
+HpackDecoder::HpackDecoder(size_t maxTableSize)
+    : maxTableSize(maxTableSize), settingsTableSize(maxTableSize)
+{
+}
+
+void HpackDecoder::evict(size_t size)
+{
+    while (!table.empty() && tableSize + size > maxTableSize) {
+        tableSize -= table.back().name.size() + table.back().value.size() + EntryOverhead;
+        table.pop_back();
+    }
+}
+
+void HpackDecoder::insert(const std::string_view& name, const std::string_view& value)
+{
+    size_t size = name.size() + value.size() + EntryOverhead;
+    // copy first, name may point at an entry that is about to be evicted
+    Entry entry{std::string(name), std::string(value)};
+    evict(size);
+    if (size > maxTableSize) return;
+    table.push_front(std::move(entry));
+    tableSize += size;
+}
+
+bool HpackDecoder::lookup(uint64_t index, std::string_view& name, std::string_view& value) const
+{
+    if (index == 0) return false;
+    if (index <= staticTableSize) {
+        name  = staticTable[index - 1].name;
+        value = staticTable[index - 1].value;
+        return true;
+    }
+    index -= staticTableSize + 1;
+    if (index >= table.size()) return false;
+    name  = table[index].name;
+    value = table[index].value;
+    return true;
+}
+
+bool HpackDecoder::decode(std::string_view               block,
+                          Arena&                         arena,
+                          std::pmr::vector<HpackHeader>& headers,
+                          size_t                         maxListSize)
+{
+    // a one byte reference to a large table entry would otherwise be copied out again and again
+    size_t listSize = 0;
+    auto   fits     = [&listSize, maxListSize](const std::string_view& name,
+                                         const std::string_view& value) {
+        listSize += name.size() + value.size() + EntryOverhead;
+        return listSize <= maxListSize;
+    };
+    while (!block.empty()) {
+        uint8_t          first = block[0];
+        std::string_view name, value;
+        if (first & 0x80) {
+            // indexed field
+            uint64_t index = decodeInt(block, 7);
+            if (!lookup(index, name, value)) throw std::runtime_error("Invalid HPACK index");
+            if (!fits(name, value)) continue;
+            // dynamic entries can be evicted by a later field in the same block
+            if (index > staticTableSize) {
+                name  = arena.copy(name);
+                value = arena.copy(value);
+            }
+            headers.push_back({name, value});
+        }
+        else if ((first & 0xe0) == 0x20) {
+            // dynamic table size update
+            uint64_t size = decodeInt(block, 5);
+            if (size > settingsTableSize) throw std::runtime_error("HPACK table size too large");
+            maxTableSize = size;
+            evict(0);
+        }
+        else {
+            // literal, with incremental indexing (01) or without (0000) or never indexed (0001)
+            bool     indexing = first & 0x40;
+            uint64_t index    = decodeInt(block, indexing ? 6 : 4);
+            if (index) {
+                if (!lookup(index, name, value)) throw std::runtime_error("Invalid HPACK index");
+            }
+            else
+                name = decodeString(block, arena);
+            value = decodeString(block, arena);
+            // insert copies name before evicting what it may point at
+            bool keep = fits(name, value);
+            if (keep && index > staticTableSize) name = arena.copy(name);
+            if (indexing) insert(name, value);
+            if (keep) headers.push_back({name, value});
+        }
+    }
+    return listSize <= maxListSize;
+}
+
+void HpackEncoder::encodeStatus(std::string& out, int status)
+{
+    // static table entries 8-14
+    static const int indexed[] = {200, 204, 206, 304, 400, 404, 500};
+    for (int i = 0; i < 7; i++) {
+        if (indexed[i] == status) {
+            out += (char)(0x80 | (8 + i));
+            return;
+        }
+    }
+    char digits[3] = {(char)('0' + status / 100 % 10), (char)('0' + status / 10 % 10),
+                      (char)('0' + status % 10)};
+    encodeInt(out, 0, 4, 8);
+    encodeString(out, std::string_view(digits, 3));
+}
+
+void HpackEncoder::encode(std::string&            out,
+                          const std::string_view& name,
+                          const std::string_view& value)
+{
+    size_t nameIndex = 0;
+    for (size_t i = 0; i < staticTableSize; i++) {
+        if (staticTable[i].name != name) continue;
+        if (staticTable[i].value == value) {
+            encodeInt(out, 0x80, 7, i + 1);
+            return;
+        }
+        if (!nameIndex) nameIndex = i + 1;
+    }
+    encodeInt(out, 0, 4, nameIndex);
+    if (!nameIndex) encodeString(out, name);
+    encodeString(out, value);
+}
+
+}; // namespace cW
@@ -0,0 +1,73 @@
+#ifndef __CW_HPACK_H_
+#define __CW_HPACK_H_
+
+#include <cstdint>
+#include <deque>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Arena.h"
+
+namespace cW {
+
+struct HpackHeader {
+    std::string_view name;
+    std::string_view value;
+};
+
+// HPACK (RFC 7541) header block decoder, one per connection since the dynamic table is shared by
+// every header block the peer sends
+class HpackDecoder {
+    struct Entry {
+        std::string name;
+        std::string value;
+    };
+
+    static const size_t EntryOverhead;
+
+    // newest entry first
+    std::deque<Entry> table;
+    size_t            tableSize = 0;
+    size_t            maxTableSize;
+    // what we advertised, table size updates can't go above it
+    size_t settingsTableSize;
+
+    void insert(const std::string_view& name, const std::string_view& value);
+    void evict(size_t size);
+    bool lookup(uint64_t index, std::string_view& name, std::string_view& value) const;
+
+  public:
+    HpackDecoder(size_t maxTableSize = 4096);
+
+    // decoded fields are appended to headers, strings point into block or the arena.
+    // throws on a malformed block, which is a connection error. false once the fields add up to
+    // more than maxListSize (name, value and 32 each, as SETTINGS_MAX_HEADER_LIST_SIZE counts),
+    // the rest of the block is still read to keep the table in sync but nothing more is copied
+    bool decode(std::string_view               block,
+                Arena&                         arena,
+                std::pmr::vector<HpackHeader>& headers,
+                size_t                         maxListSize);
+};
+
+// stateless encoder, fields are sent as literals without indexing (or from the static table) so
+// there is no dynamic table to keep in sync with the peer
+class HpackEncoder {
+  public:
+    // name must already be lowercase
+    static void encode(std::string&            out,
+                       const std::string_view& name,
+                       const std::string_view& value);
+    static void encodeStatus(std::string& out, int status);
+};
+
+namespace Huffman {
+// out needs room for in.size() * 8 / 5 bytes, false if in isn't a valid huffman string
+bool   decode(const std::string_view& in, char* out, size_t& outLength);
+size_t encodedLength(const std::string_view& in);
+void   encode(const std::string_view& in, std::string& out);
+}; // namespace Huffman
+
+}; // namespace cW
+
+#endif
@@ -0,0 +1,704 @@
+#include "Http2Session.h"
+
+#include <algorithm>
+#include "ClientSocket.h"
+#include "Server.h"
+#include "base64.h"
+
+namespace cW {
+
+const std::string_view Http2Session::Preface              = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+const size_t           Http2Session::MaxConcurrentStreams = 128;
+const uint32_t         Http2Session::MaxFrameSize         = 16384;
+const int32_t          Http2Session::StreamWindowSize     = 1024 * 1024;
+const int32_t          Http2Session::ConnectionWindowSize = 16 * 1024 * 1024;
+const size_t           Http2Session::MaxHeaderBlockLength = 64 * 1024;
+const size_t           Http2Session::MaxHeaderListLength  = 64 * 1024;
+const size_t           Http2Session::MaxBufferedOutput    = 256 * 1024;
+
+namespace {
+inline uint32_t readU32(const char* data)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 |
+           bytes[3];
+}
+
+inline void putU32(char* data, uint32_t value)
+{
+    data[0] = (char)(value >> 24);
+    data[1] = (char)(value >> 16);
+    data[2] = (char)(value >> 8);
+    data[3] = (char)value;
+}
+
+bool stripPadding(uint8_t flags, std::string_view& payload)
+{
+    if (!(flags & 0x8)) return true;
+    if (payload.empty()) return false;
+    size_t padding = (uint8_t)payload[0];
+    if (padding >= payload.size()) return false;
+    payload = payload.substr(1, payload.size() - 1 - padding);
+    return true;
+}
+
+// http/1.1 only headers, not allowed on an http/2 connection
+bool connectionSpecific(const std::string_view& name)
+{
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+           name == "transfer-encoding" || name == "upgrade";
+}
+
+// the header text is rebuilt from decoded fields, line breaks would let a value forge headers
+bool validField(const std::string_view& field)
+{
+    return field.find_first_of(std::string_view("\r\n\0", 3)) == std::string_view::npos;
+}
+} // namespace
+
+void Http2Session::Stream::reset(uint32_t id, int64_t sendWindow)
+{
+    this->id         = id;
+    request          = nullptr;
+    response         = nullptr;
+    hasHandler       = false;
+    endReceived      = false;
+    doneReceiving    = false;
+    wroteHeaders     = false;
+    doneWriting      = false;
+    bodyReceived     = 0;
+    writeOffset      = 0;
+    this->sendWindow = sendWindow;
+    recvUnacked      = 0;
+}
+
+Http2Session::Http2Session(ClientSocket* socket) : Session(socket, Session::HTTP2) { start(); }
+
+Http2Session::Http2Session(ClientSocket* socket, const std::string_view& requestHeader)
+    : Session(socket, Session::HTTP2)
+{
+    output += "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+    start();
+    // client settings come base64url encoded in HTTP2-Settings, the 101 acknowledges them
+    if (size_t pos = ci_find<true>(requestHeader, "http2-settings:"); pos != __INF__) {
+        std::string_view value = requestHeader.substr(pos + 15);
+        value                  = value.substr(0, value.find("\r\n"));
+        while (!value.empty() && value.front() == ' ')
+            value.remove_prefix(1);
+        while (!value.empty() && value.back() == ' ')
+            value.remove_suffix(1);
+        std::string encoded(value);
+        encoded.append((4 - encoded.size() % 4) % 4, '=');
+        try {
+            applySettings(base64::base64_decode(encoded));
+        }
+        catch (...) {
+            connectionError(PROTOCOL_ERROR, "Invalid HTTP2-Settings");
+        }
+        if (closing) return;
+    }
+    Stream* stream = openStream(1);
+    lastStreamId   = 1;
+    dispatch(stream, stream->arena.copy(requestHeader), true);
+}
+
+void Http2Session::start()
+{
+    char settings[24];
+    // SETTINGS_ENABLE_PUSH = 0, SETTINGS_MAX_CONCURRENT_STREAMS, SETTINGS_INITIAL_WINDOW_SIZE,
+    // SETTINGS_MAX_HEADER_LIST_SIZE
+    const std::pair<uint16_t, uint32_t> values[] = {{2, 0},
+                                                    {3, (uint32_t)MaxConcurrentStreams},
+                                                    {4, (uint32_t)StreamWindowSize},
+                                                    {6, (uint32_t)MaxHeaderListLength}};
+    for (int i = 0; i < 4; i++) {
+        settings[i * 6]     = (char)(values[i].first >> 8);
+        settings[i * 6 + 1] = (char)values[i].first;
+        putU32(settings + i * 6 + 2, values[i].second);
+    }
+    writeFrame(SETTINGS, 0, 0, std::string_view(settings, sizeof(settings)));
+    // the connection window can only be raised with WINDOW_UPDATE
+    writeWindowUpdate(0, ConnectionWindowSize - 65535);
+    socket->wantWrite = true;
+}
+
+void Http2Session::writeFrame(uint8_t                 type,
+                              uint8_t                 flags,
+                              uint32_t                streamId,
+                              const std::string_view& payload)
+{
+    char header[9];
+    header[0] = (char)(payload.size() >> 16);
+    header[1] = (char)(payload.size() >> 8);
+    header[2] = (char)payload.size();
+    header[3] = (char)type;
+    header[4] = (char)flags;
+    putU32(header + 5, streamId & 0x7fffffff);
+    output.append(header, 9);
+    output.append(payload);
+}
+
+void Http2Session::writeReset(uint32_t streamId, ErrorCode code)
+{
+    char payload[4];
+    putU32(payload, code);
+    writeFrame(RST_STREAM, 0, streamId, std::string_view(payload, 4));
+}
+
+void Http2Session::writeWindowUpdate(uint32_t streamId, uint32_t increment)
+{
+    char payload[4];
+    putU32(payload, increment);
+    writeFrame(WINDOW_UPDATE, 0, streamId, std::string_view(payload, 4));
+}
+
+void Http2Session::writeHeaders(Stream* stream, bool endStream)
+{
+    static thread_local std::string block, name;
+    HttpResponse*                   response = stream->response;
+    block.clear();
+    HpackEncoder::encodeStatus(block, (int)response->statusCode);
+    for (auto& [key, value] : response->headers) {
+        name.assign(key);
+        for (char& c : name)
+            c = to_lower(c);
+        if (connectionSpecific(name)) continue;
+        HpackEncoder::encode(block, name, value);
+    }
+    // blocks larger than a frame continue in CONTINUATION frames
+    std::string_view rest  = block;
+    uint8_t          flags = endStream ? END_STREAM : 0;
+    uint8_t          type  = HEADERS;
+    do {
+        std::string_view fragment = rest.substr(0, peerMaxFrameSize);
+        rest.remove_prefix(fragment.size());
+        writeFrame(type, flags | (rest.empty() ? END_HEADERS : 0), stream->id, fragment);
+        type  = CONTINUATION;
+        flags = 0;
+    } while (!rest.empty());
+}
+
+void Http2Session::connectionError(ErrorCode code, const char* reason)
+{
+    std::cerr << "HTTP/2 connection error: " << reason << std::endl;
+    char payload[8];
+    putU32(payload, lastStreamId);
+    putU32(payload + 4, code);
+    writeFrame(GOAWAY, 0, 0, std::string_view(payload, 8));
+    socket->write(output, true);
+    output.clear();
+    closing = true;
+    socket->disconnect();
+}
+
+void Http2Session::applySettings(const std::string_view& payload)
+{
+    for (size_t i = 0; i + 6 <= payload.size(); i += 6) {
+        uint16_t id    = (uint8_t)payload[i] << 8 | (uint8_t)payload[i + 1];
+        uint32_t value = readU32(payload.data() + i + 2);
+        if (id == 4) {
+            // SETTINGS_INITIAL_WINDOW_SIZE, open streams move by the difference
+            if (value > 0x7fffffff)
+                return connectionError(FLOW_CONTROL_ERROR, "Initial window too large");
+            for (auto& [streamId, stream] : streams)
+                if ((stream->sendWindow += (int64_t)value - peerInitialWindow) > 0x7fffffff)
+                    return connectionError(FLOW_CONTROL_ERROR, "Stream window overflow");
+            peerInitialWindow = value;
+        }
+        else if (id == 5) {
+            // SETTINGS_MAX_FRAME_SIZE
+            if (value < 16384 || value > 16777215)
+                return connectionError(PROTOCOL_ERROR, "Invalid max frame size");
+            peerMaxFrameSize = value;
+        }
+        // we never index response headers or push, so the rest doesn't matter
+    }
+}
+
+void Http2Session::onSettings(uint8_t flags, const std::string_view& payload)
+{
+    if (flags & ACK) {
+        if (!payload.empty()) connectionError(FRAME_SIZE_ERROR, "Settings ack with payload");
+        return;
+    }
+    if (payload.size() % 6) return connectionError(FRAME_SIZE_ERROR, "Invalid settings length");
+    applySettings(payload);
+    if (!closing) writeFrame(SETTINGS, ACK, 0, std::string_view());
+}
+
+void Http2Session::onWindowUpdate(uint32_t streamId, const std::string_view& payload)
+{
+    if (payload.size() != 4) return connectionError(FRAME_SIZE_ERROR, "Invalid window update");
+    uint32_t increment = readU32(payload.data()) & 0x7fffffff;
+    if (streamId == 0) {
+        if (increment == 0) return connectionError(PROTOCOL_ERROR, "Zero window update");
+        sendWindow += increment;
+        if (sendWindow > 0x7fffffff)
+            return connectionError(FLOW_CONTROL_ERROR, "Connection window overflow");
+    }
+    else if (auto itr = streams.find(streamId); itr != streams.end()) {
+        Stream* stream = itr->second;
+        if (increment == 0 || (stream->sendWindow += increment) > 0x7fffffff) {
+            writeReset(streamId, increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+            return closeStream(stream, true);
+        }
+    }
+    socket->wantWrite = true;
+}
+
+Http2Session::Stream* Http2Session::openStream(uint32_t id)
+{
+    Stream* stream;
+    if (freeStreams.empty())
+        stream = new Stream();
+    else {
+        stream = freeStreams.back();
+        freeStreams.pop_back();
+    }
+    stream->reset(id, peerInitialWindow);
+    streams[id] = stream;
+    return stream;
+}
+
+void Http2Session::closeStream(Stream* stream, bool aborted)
+{
+    if (aborted && !stream->doneWriting && stream->response &&
+        stream->response->onAbortCallback)
+        stream->response->onAbortCallback();
+    Arena::destroy(stream->request);
+    Arena::destroy(stream->response);
+    stream->arena.reset();
+    streams.erase(stream->id);
+    // kept for the next stream, with its arena block
+    if (freeStreams.size() < MaxConcurrentStreams)
+        freeStreams.push_back(stream);
+    else
+        delete stream;
+}
+
+// answers with a bare status in place of the handler, whatever it sends is dropped
+void Http2Session::refuse(Stream* stream, HttpStatus::Code status)
+{
+    if (stream->wroteHeaders)
+        writeReset(stream->id, INTERNAL_ERROR);
+    else {
+        std::string block;
+        HpackEncoder::encodeStatus(block, (int)status);
+        writeFrame(HEADERS, END_HEADERS | END_STREAM, stream->id, block);
+        // asks the client to stop sending the body
+        if (!stream->endReceived) writeReset(stream->id, NO_ERROR);
+    }
+    closeStream(stream, true);
+}
+
+void Http2Session::dispatch(Stream* stream, const std::string_view& requestHeader, bool endStream)
+{
+    Arena& arena     = stream->arena;
+    stream->request  = new (arena.alloc(sizeof(HttpRequest), alignof(HttpRequest)))
+        HttpRequest(arena, requestHeader);
+    stream->response = new (arena.alloc(sizeof(HttpResponse), alignof(HttpResponse)))
+        HttpResponse(arena, stream->request);
+    HttpRequest* request  = stream->request;
+    stream->endReceived   = endStream;
+    stream->doneReceiving = endStream;
+    try {
+        stream->hasHandler = socket->server->dispatch(request, stream->response);
+    }
+    catch (std::runtime_error& error) {
+        std::cerr << error.what() << std::endl;
+        return refuse(stream, HttpStatus::InternalServerError);
+    }
+    request->inHandler = false;
+    if (!stream->hasHandler) return refuse(stream, HttpStatus::NotFound);
+    if (!endStream) {
+        // a body without content-length ends with END_STREAM
+        std::string_view contentLength;
+        if (!request->findHeader("content-length", contentLength))
+            request->contentLength = __INF__;
+        HttpStatus::Code status;
+        if (request->contentLength != __INF__ &&
+            request->contentLength > request->opts->MaxBodyLength)
+            return refuse(stream, HttpStatus::PayloadTooLarge);
+        if ((status = request->beginBody()) != HttpStatus::OK) return refuse(stream, status);
+        // nobody is listening for the body
+        stream->doneReceiving = !request->onDataCallback && !request->onBodyCallback;
+    }
+    socket->wantWrite = true;
+}
+
+void Http2Session::feedBody(Stream* stream, const std::string_view& data, bool complete)
+{
+    try {
+        HttpStatus::Code status = stream->request->feedBody(data, complete, stream->doneReceiving);
+        if (status != HttpStatus::OK) return refuse(stream, status);
+    }
+    catch (std::runtime_error& error) {
+        std::cerr << error.what() << std::endl;
+        return refuse(stream, HttpStatus::BadRequest);
+    }
+}
+
+void Http2Session::onHeaders(uint32_t streamId, uint8_t flags, const std::string_view& block)
+{
+    std::pmr::vector<HpackHeader> fields(&scratch);
+    bool                          fits;
+    try {
+        // has to run even for streams we refuse, the dynamic table must stay in sync
+        fits = decoder.decode(block, scratch, fields, MaxHeaderListLength);
+    }
+    catch (std::runtime_error& error) {
+        return connectionError(COMPRESSION_ERROR, error.what());
+    }
+    bool endStream = flags & END_STREAM;
+    if (auto itr = streams.find(streamId); itr != streams.end()) {
+        // trailers, they end the body and are dropped
+        Stream* stream = itr->second;
+        if (!endStream || stream->endReceived)
+            return connectionError(PROTOCOL_ERROR, "Headers on an open stream");
+        stream->endReceived = true;
+        if (!stream->doneReceiving) feedBody(stream, std::string_view(), true);
+        stream->doneReceiving = true;
+        socket->wantWrite     = true;
+        return scratch.reset();
+    }
+    if (!(streamId & 1) || streamId <= lastStreamId)
+        return connectionError(PROTOCOL_ERROR, "Invalid stream id");
+    lastStreamId = streamId;
+    if (goingAway) return scratch.reset();
+    if (streams.size() >= MaxConcurrentStreams) {
+        writeReset(streamId, REFUSED_STREAM);
+        return scratch.reset();
+    }
+    if (!fits) {
+        // over what we advertised, answered without a stream like refuse() would
+        std::string status;
+        HpackEncoder::encodeStatus(status, HttpStatus::RequestHeaderFieldsTooLarge);
+        writeFrame(HEADERS, END_HEADERS | END_STREAM, streamId, status);
+        if (!endStream) writeReset(streamId, NO_ERROR);
+        return scratch.reset();
+    }
+
+    // rebuilt as an http/1.1 header so HttpRequest parses it like any other request
+    std::string_view method, path, authority;
+    size_t           length  = 0;
+    bool             hasHost = false;
+    bool             valid   = true;
+    for (auto& field : fields) {
+        valid = valid && validField(field.name) && validField(field.value);
+        if (field.name == ":method")
+            method = field.value;
+        else if (field.name == ":path")
+            path = field.value;
+        else if (field.name == ":authority")
+            authority = field.value;
+        else if (!field.name.empty() && field.name[0] != ':') {
+            length += field.name.size() + field.value.size() + 4;
+            hasHost = hasHost || field.name == "host";
+        }
+    }
+    if (!valid || method.empty() || path.empty() ||
+        path.find(' ') != std::string_view::npos) {
+        writeReset(streamId, PROTOCOL_ERROR);
+        return scratch.reset();
+    }
+    Stream* stream = openStream(streamId);
+    length += method.size() + path.size() + 11 + (hasHost ? 0 : authority.size() + 8);
+    char* text = (char*)stream->arena.alloc(length, 1);
+    char* end  = text;
+    auto  put  = [&end](const std::string_view& str) {
+        std::memcpy(end, str.data(), str.size());
+        end += str.size();
+    };
+    put(method);
+    put(" ");
+    put(path);
+    put(" HTTP/2\r\n");
+    if (!hasHost) {
+        put("host: ");
+        put(authority);
+        put("\r\n");
+    }
+    for (auto& field : fields) {
+        if (field.name.empty() || field.name[0] == ':') continue;
+        put(field.name);
+        put(": ");
+        put(field.value);
+        put("\r\n");
+    }
+    scratch.reset();
+    dispatch(stream, std::string_view(text, end - text), endStream);
+}
+
+void Http2Session::onDataFrame(uint32_t streamId, uint8_t flags, std::string_view payload)
+{
+    // flow control counts the whole frame, padding included, even on closed streams
+    int32_t frameLength = (int32_t)payload.size();
+    // what isn't given back yet is all the peer may have in flight
+    if (frameLength > ConnectionWindowSize - recvUnacked)
+        return connectionError(FLOW_CONTROL_ERROR, "Connection window exceeded");
+    recvUnacked += frameLength;
+    if (recvUnacked >= ConnectionWindowSize / 2) {
+        writeWindowUpdate(0, recvUnacked);
+        recvUnacked = 0;
+    }
+    if (!stripPadding(flags, payload)) return connectionError(PROTOCOL_ERROR, "Invalid padding");
+    auto itr = streams.find(streamId);
+    if (itr == streams.end()) {
+        if (streamId > lastStreamId) connectionError(PROTOCOL_ERROR, "Data on an idle stream");
+        // stream we already closed, the data is dropped
+        return;
+    }
+    Stream* stream = itr->second;
+    if (stream->endReceived) {
+        writeReset(streamId, STREAM_CLOSED);
+        return closeStream(stream, true);
+    }
+    bool complete = flags & END_STREAM;
+    if (complete)
+        stream->endReceived = true;
+    else if ((stream->recvUnacked += frameLength) > StreamWindowSize) {
+        writeReset(streamId, FLOW_CONTROL_ERROR);
+        return closeStream(stream, true);
+    }
+    else if (stream->recvUnacked >= StreamWindowSize / 2) {
+        // the callbacks have seen the data by the time this goes out
+        writeWindowUpdate(streamId, stream->recvUnacked);
+        stream->recvUnacked = 0;
+    }
+    stream->bodyReceived += payload.size();
+    if (stream->bodyReceived > stream->request->opts->MaxBodyLength)
+        return refuse(stream, HttpStatus::PayloadTooLarge);
+    if (!stream->doneReceiving) feedBody(stream, payload, complete);
+    if (complete) stream->doneReceiving = true;
+}
+
+void Http2Session::onFrame(uint8_t type, uint8_t flags, uint32_t streamId, std::string_view payload)
+{
+    if (headerStream && type != CONTINUATION)
+        return connectionError(PROTOCOL_ERROR, "Expected continuation");
+    switch (type) {
+        case DATA:
+            if (streamId == 0) return connectionError(PROTOCOL_ERROR, "Data on stream 0");
+            return onDataFrame(streamId, flags, payload);
+        case HEADERS:
+            if (streamId == 0) return connectionError(PROTOCOL_ERROR, "Headers on stream 0");
+            if (!stripPadding(flags, payload))
+                return connectionError(PROTOCOL_ERROR, "Invalid padding");
+            // priority information is not used
+            if (flags & PRIORITY_) {
+                if (payload.size() < 5) return connectionError(FRAME_SIZE_ERROR, "Short headers");
+                payload.remove_prefix(5);
+            }
+            if (flags & END_HEADERS) return onHeaders(streamId, flags, payload);
+            headerBlock.assign(payload);
+            headerStream = streamId;
+            headerFlags  = flags;
+            return;
+        case CONTINUATION:
+            if (!headerStream || streamId != headerStream)
+                return connectionError(PROTOCOL_ERROR, "Unexpected continuation");
+            headerBlock.append(payload);
+            if (headerBlock.size() > MaxHeaderBlockLength)
+                return connectionError(PROTOCOL_ERROR, "Header block too large");
+            if (flags & END_HEADERS) {
+                headerStream = 0;
+                onHeaders(streamId, headerFlags, headerBlock);
+            }
+            return;
+        case PRIORITY:
+            if (payload.size() != 5) connectionError(FRAME_SIZE_ERROR, "Invalid priority");
+            return;
+        case RST_STREAM:
+            if (streamId == 0 || payload.size() != 4)
+                return connectionError(PROTOCOL_ERROR, "Invalid reset");
+            if (auto itr = streams.find(streamId); itr != streams.end())
+                closeStream(itr->second, true);
+            return;
+        case SETTINGS:
+            if (streamId != 0) return connectionError(PROTOCOL_ERROR, "Settings on a stream");
+            return onSettings(flags, payload);
+        case PUSH_PROMISE: return connectionError(PROTOCOL_ERROR, "Push from a client");
+        case PING:
+            if (streamId != 0 || payload.size() != 8)
+                return connectionError(FRAME_SIZE_ERROR, "Invalid ping");
+            if (!(flags & ACK)) writeFrame(PING, ACK, 0, payload);
+            return;
+        case GOAWAY:
+            // no new streams, the open ones finish
+            goingAway = true;
+            return;
+        case WINDOW_UPDATE: return onWindowUpdate(streamId, payload);
+        default:
+            // unknown frame types are ignored
+            return;
+    }
+}
+
+void Http2Session::onData(const std::string_view& data)
+{
+    if (closing) return;
+    std::string_view buffer = data;
+    if (!input.empty()) {
+        input.append(data);
+        buffer = input;
+    }
+    size_t used = 0;
+    if (!prefaceReceived) {
+        size_t len = std::min(buffer.size(), Preface.size());
+        if (buffer.substr(0, len) != Preface.substr(0, len))
+            return connectionError(PROTOCOL_ERROR, "Invalid connection preface");
+        if (len == Preface.size()) {
+            prefaceReceived = true;
+            used            = len;
+        }
+    }
+    while (prefaceReceived && !closing && buffer.size() - used >= 9) {
+        const char* header = buffer.data() + used;
+        uint32_t    length = readU32(header) >> 8;
+        if (length > MaxFrameSize) return connectionError(FRAME_SIZE_ERROR, "Frame too large");
+        if (buffer.size() - used < 9 + length) break;
+        onFrame((uint8_t)header[3],
+                (uint8_t)header[4],
+                readU32(header + 5) & 0x7fffffff,
+                std::string_view(header + 9, length));
+        used += 9 + length;
+    }
+    if (closing) return;
+    // partial frame waits for the next read
+    if (!input.empty())
+        input.erase(0, used);
+    else
+        input.assign(buffer.substr(used));
+    socket->wantWrite = true;
+}
+
+bool Http2Session::writeStream(Stream* stream)
+{
+    HttpResponse* response = stream->response;
+    // the connection can't sleep for one stream, a follower is skipped until its leader answers
+    // and the socket is handed back for another round
+    if (!stream->wroteHeaders && response->flight &&
+        SingleFlight::wait(stream->request, response, socket, false))
+        return false;
+    if (stream->doneWriting) return false;
+    // only a body callback can still answer, without one the empty response goes out
+    if (response->pending() && !stream->doneReceiving) return false;
+    if (!stream->wroteHeaders) {
+        response->share();
+        if (response->cached && !response->conditionsChecked) response->replay();
+        if (!response->conditionsChecked) {
+            // DATA frames aren't compressed on the fly, ranges and validators still apply
+            response->beginStream(false);
+            stream->writeOffset = response->writeStart;
+        }
+        if (response->onWritableCallback) {
+            try {
+                response->onWritableCallback(stream->writeOffset);
+                response->trimBuffer(stream->writeOffset);
+            }
+            catch (std::runtime_error& error) {
+                std::cerr << error.what() << std::endl;
+                // the reset ends both sides
+                writeReset(stream->id, INTERNAL_ERROR);
+                stream->endReceived = stream->doneWriting = true;
+                return false;
+            }
+        }
+        bool empty =
+            stream->request->method == HttpMethod::HEAD || response->contentLength == 0 ||
+            (response->buffer.empty() && (!response->onWritableCallback || response->close));
+        writeHeaders(stream, empty);
+        stream->wroteHeaders = true;
+        if (empty) {
+            stream->doneWriting = true;
+            return false;
+        }
+    }
+    else if (response->onWritableCallback && response->buffer.empty()) {
+        response->onWritableCallback(stream->writeOffset);
+        response->trimBuffer(stream->writeOffset);
+    }
+
+    int64_t window = std::min(sendWindow, stream->sendWindow);
+    while (!response->buffer.empty() && window > 0 &&
+           output.size() + socket->writeBuffer.size() < MaxBufferedOutput) {
+        size_t size =
+            std::min({response->buffer.size(), (size_t)window, (size_t)peerMaxFrameSize});
+        stream->writeOffset += size;
+        bool last = size == response->buffer.size() &&
+                    (stream->writeOffset >= response->contentLength || response->close ||
+                     !response->onWritableCallback);
+        writeFrame(DATA, last ? END_STREAM : 0, stream->id, response->buffer.substr(0, size));
+        response->buffer.remove_prefix(size);
+        window -= size;
+        sendWindow -= size;
+        stream->sendWindow -= size;
+        if (last) {
+            stream->doneWriting = true;
+            return false;
+        }
+    }
+    if (response->buffer.empty() &&
+        (stream->writeOffset >= response->contentLength || response->close)) {
+        writeFrame(DATA, END_STREAM, stream->id, std::string_view());
+        stream->doneWriting = true;
+        return false;
+    }
+    return response->buffer.empty() ? response->onWritableCallback != nullptr : window > 0;
+}
+
+// one round over the streams, whatever they produce leaves in a single write
+void Http2Session::onWritable()
+{
+    static thread_local std::vector<Stream*> ready;
+    bool                                     more = false;
+    ready.clear();
+    for (auto& [id, stream] : streams)
+        ready.push_back(stream);
+    // rotate so one large response doesn't always go first
+    if (!ready.empty())
+        std::rotate(ready.begin(), ready.begin() + rounds++ % ready.size(), ready.end());
+    for (Stream* stream : ready) {
+        more = writeStream(stream) || more;
+        if (stream->doneWriting && (stream->endReceived || stream->doneReceiving)) {
+            // the body isn't wanted any more, stop the client sending it
+            if (!stream->endReceived) writeReset(stream->id, NO_ERROR);
+            closeStream(stream);
+        }
+    }
+    if (!output.empty()) {
+        socket->write(output, true);
+        output.clear();
+    }
+    else if (!socket->writeBuffer.empty())
+        socket->write(nullptr, 0, true);
+    socket->wantWrite = !socket->writeBuffer.empty() || more;
+}
+
+bool Http2Session::shouldEnd()
+{
+    if (closing) return true;
+    if (goingAway && streams.empty() && output.empty() && socket->writeBuffer.empty()) {
+        socket->disconnect();
+        return true;
+    }
+    return false;
+}
+
+void Http2Session::onAwakePre() {}
+void Http2Session::onAwakePost() {}
+
+void Http2Session::onAborted()
+{
+    while (!streams.empty())
+        closeStream(streams.begin()->second, true);
+}
+
+Http2Session::~Http2Session()
+{
+    onAborted();
+    for (auto stream : freeStreams)
+        delete stream;
+}
+
+}; // namespace cW
@@ -0,0 +1,165 @@
+#ifndef __CW_HTTP2_SESSION_H_
+#define __CW_HTTP2_SESSION_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Arena.h"
+#include "Hpack.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "Session.h"
+
+//  +-----------------------------------------------+
+//  |                 Length (24)                   |
+//  +---------------+---------------+---------------+
+//  |   Type (8)    |   Flags (8)   |
+//  +-+-------------+---------------+-------------------------------+
+//  |R|                 Stream Identifier (31)                      |
+//  +=+=============================================================+
+//  |                   Frame Payload (0...)                      ...
+//  +---------------------------------------------------------------+
+
+namespace cW {
+
+class ClientSocket;
+
+// cleartext http/2 connection, reached with prior knowledge or an h2c upgrade. every stream gets
+// its own HttpRequest/HttpResponse and goes through the router like an http/1.1 request.
+class Http2Session : Session {
+    friend class Poll;
+    friend class ClientSocket;
+    friend class Server;
+
+    enum FrameType : uint8_t {
+        DATA,
+        HEADERS,
+        PRIORITY,
+        RST_STREAM,
+        SETTINGS,
+        PUSH_PROMISE,
+        PING,
+        GOAWAY,
+        WINDOW_UPDATE,
+        CONTINUATION
+    };
+    enum Flag : uint8_t {
+        END_STREAM  = 0x1,
+        ACK         = 0x1,
+        END_HEADERS = 0x4,
+        PADDED      = 0x8,
+        PRIORITY_   = 0x20
+    };
+    enum ErrorCode : uint32_t {
+        NO_ERROR,
+        PROTOCOL_ERROR,
+        INTERNAL_ERROR,
+        FLOW_CONTROL_ERROR,
+        SETTINGS_TIMEOUT,
+        STREAM_CLOSED,
+        FRAME_SIZE_ERROR,
+        REFUSED_STREAM,
+        CANCEL,
+        COMPRESSION_ERROR
+    };
+
+    static const std::string_view Preface;
+    static const size_t           MaxConcurrentStreams;
+    static const uint32_t         MaxFrameSize;
+    static const int32_t          StreamWindowSize;
+    static const int32_t          ConnectionWindowSize;
+    static const size_t           MaxHeaderBlockLength;
+    // advertised as SETTINGS_MAX_HEADER_LIST_SIZE, a request over it is answered with 431
+    static const size_t MaxHeaderListLength;
+    // frames queued beyond this wait for the socket to drain
+    static const size_t MaxBufferedOutput;
+
+    struct Stream {
+        uint32_t id;
+        // request and response memory, reset when the stream is recycled
+        Arena         arena;
+        HttpRequest*  request  = nullptr;
+        HttpResponse* response = nullptr;
+
+        bool hasHandler    = false;
+        bool endReceived   = false;
+        bool doneReceiving = false;
+        bool wroteHeaders  = false;
+        bool doneWriting   = false;
+
+        size_t  bodyReceived = 0;
+        size_t  writeOffset  = 0;
+        int64_t sendWindow   = 0;
+        // received bytes not yet given back with WINDOW_UPDATE
+        int32_t recvUnacked = 0;
+
+        void reset(uint32_t id, int64_t sendWindow);
+    };
+
+    bool         prefaceReceived = false;
+    bool         goingAway       = false;
+    bool         closing         = false;
+    uint32_t     lastStreamId    = 0;
+    std::string  input;
+    std::string  output;
+    HpackDecoder decoder;
+    // decoded header fields, reset after every header block
+    Arena  scratch;
+    size_t rounds = 0;
+
+    std::unordered_map<uint32_t, Stream*> streams;
+    std::vector<Stream*>                  freeStreams;
+
+    // header block split over CONTINUATION frames
+    std::string headerBlock;
+    uint32_t    headerStream = 0;
+    uint8_t     headerFlags  = 0;
+
+    // peer settings and our send window
+    uint32_t peerMaxFrameSize  = 16384;
+    int64_t  peerInitialWindow = 65535;
+    int64_t  sendWindow        = 65535;
+    // received bytes not yet given back with WINDOW_UPDATE
+    int32_t recvUnacked = 0;
+
+    Http2Session(ClientSocket* socket);
+    // h2c upgrade, the request becomes stream 1
+    Http2Session(ClientSocket* socket, const std::string_view& requestHeader);
+
+    void start();
+    void applySettings(const std::string_view& payload);
+    void writeFrame(uint8_t                 type,
+                    uint8_t                 flags,
+                    uint32_t                streamId,
+                    const std::string_view& payload);
+    void writeHeaders(Stream* stream, bool endStream);
+    void writeReset(uint32_t streamId, ErrorCode code);
+    void writeWindowUpdate(uint32_t streamId, uint32_t increment);
+    void connectionError(ErrorCode code, const char* reason);
+
+    void onFrame(uint8_t type, uint8_t flags, uint32_t streamId, std::string_view payload);
+    void onHeaders(uint32_t streamId, uint8_t flags, const std::string_view& block);
+    void onDataFrame(uint32_t streamId, uint8_t flags, std::string_view payload);
+    void onSettings(uint8_t flags, const std::string_view& payload);
+    void onWindowUpdate(uint32_t streamId, const std::string_view& payload);
+
+    Stream* openStream(uint32_t id);
+    void    dispatch(Stream* stream, const std::string_view& requestHeader, bool endStream);
+    void    feedBody(Stream* stream, const std::string_view& data, bool complete);
+    void    refuse(Stream* stream, HttpStatus::Code status);
+    void    closeStream(Stream* stream, bool aborted = false);
+    // returns true while the stream has more to send and the window to send it
+    bool writeStream(Stream* stream);
+
+    void onAwakePre() override;
+    void onAwakePost() override;
+    void onAborted() override;
+    void onWritable() override;
+    void onData(const std::string_view& data) override;
+    bool shouldEnd() override;
+    ~Http2Session();
+};
+
+}; // namespace cW
+
+#endif
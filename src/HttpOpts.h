@@ -0,0 +1,43 @@
+#ifndef __CW_HTTP_OPTS_H_
+#define __CW_HTTP_OPTS_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace cW {
+
+// per route options
+struct HttpOpts {
+    // larger bodies are refused with 413
+    size_t MaxBodyLength = 64 * 1024 * 1024;
+    // larger bodies given to onBody are spilled to a temp file instead of memory
+    size_t MaxMemoryBodyLength = 1024 * 1024;
+
+    // gzip/deflate request bodies reach onData/onBody inflated
+    bool Decompress = true;
+    // inflated size limit, a small body can expand into gigabytes
+    size_t MaxDecompressedLength = 64 * 1024 * 1024;
+
+    // compress responses with an encoding from the client's accept-encoding
+    bool Compress = false;
+    // smaller bodies are sent as they are
+    size_t MinCompressLength = 1024;
+    // zlib level for gzip/deflate
+    int CompressionLevel = 6;
+
+    // milliseconds a GET response is replayed from the per-thread micro-cache, 0 disables it
+    size_t CacheTTL = 0;
+    // query parameters and (lowercase) request headers that select between cached variants
+    std::vector<std::string> CacheKeyQueries;
+    std::vector<std::string> CacheKeyHeaders;
+    // larger responses are never cached
+    size_t MaxCachedLength = 1024 * 1024;
+    // concurrent GETs with the same cache key run the handler once, on any thread, and the rest
+    // wait for its response
+    bool CoalesceRequests = false;
+};
+
+}; // namespace cW
+
+#endif
@@ -1,5 +1,6 @@
 #include <iostream>
 #include "HttpRequest.h"
+#include "Rcu.h"
 
 namespace cW {
 
@@ -41,7 +42,11 @@ bool HttpRequest::QueryComp::operator()(const std::string_view& a, const std::st
     }
 }
 
-HttpRequest::HttpRequest(const std::string_view& requestHeader) { parse(requestHeader); }
+HttpRequest::HttpRequest(Arena& arena, const std::string_view& requestHeader)
+    : memory(arena), headers(&arena), queries(&arena)
+{
+    parse(requestHeader);
+}
 
 void HttpRequest::parse(const std::string_view& requestHeader)
 {
@@ -76,6 +81,41 @@ void HttpRequest::parse(const std::string_view& requestHeader)
     headerSection        = requestHeader.substr(statusLineEnd);
     getContentLength();
 }
+bool HttpRequest::findHeader(const std::string_view& key, std::string_view& value)
+{
+    if (!headersSplitted) {
+        size_t len = headerSection.size();
+        for (size_t i = 0; i < len;) {
+            size_t next = std::min(headerSection.find("\r\n", i), len);
+            if (next > i) headers.insert(headerSection.substr(i, next - i));
+            i = next + 2;
+        }
+        headersSplitted = true;
+    }
+    auto itr = headers.lower_bound(key);
+    if (itr == headers.end() || HeaderComp()(key, *itr)) return false;
+    const std::string_view& line  = *itr;
+    size_t                  first = line.find(':') + 1, last = line.size();
+    while (first < last && line[first] == ' ')
+        first++;
+    while (last > first && line[last - 1] == ' ')
+        last--;
+    value = line.substr(first, last - first);
+    return true;
+}
+
+void HttpRequest::splitQueries()
+{
+    if (queriesSplitted) return;
+    size_t len = querySection.size();
+    for (size_t i = 0; i < len;) {
+        size_t next = std::min(querySection.find('&', i), len);
+        queries.insert(querySection.substr(i, next - i));
+        i = next + 1;
+    }
+    queriesSplitted = true;
+}
+
 // callback for more data
 HttpRequest* HttpRequest::onData(std::function<bool(std::string_view)>&& onDataCallback)
 {
@@ -91,11 +131,92 @@ HttpRequest* HttpRequest::onBody(std::function<void(std::string_view)>&& onBodyC
     return this;
 }
 
+HttpRequest* HttpRequest::onMultipart(MultipartParser::PartHandler&& onPart,
+                                      MultipartParser::EndHandler&&  onEnd,
+                                      MultipartParser::PartHandler&& onPartEnd)
+{
+    std::string_view boundary = MultipartParser::boundaryOf(getHeader("content-type"));
+    if (boundary.empty()) throw std::runtime_error("Request body is not multipart");
+    // header views die with the receive buffer, the parser outlives it
+    multipart = memory.make<MultipartParser>(
+        memory, memory.copy(boundary), std::move(onPart), std::move(onEnd), std::move(onPartEnd));
+    return onData([this](std::string_view data) { return multipart->feed(data); });
+}
+
+HttpStatus::Code HttpRequest::beginBody()
+{
+    std::string_view contentEncoding;
+    ContentEncoding  encoding;
+    if (!onDataCallback && !onBodyCallback) return HttpStatus::OK;
+    if (opts->Decompress && findHeader("content-encoding", contentEncoding)) {
+        if (!parseContentEncoding(contentEncoding, encoding))
+            return HttpStatus::UnsupportedMediaType;
+        if (encoding != ContentEncoding::IDENTITY) inflater = Inflater::acquire();
+    }
+    // inflated size isn't known until the end
+    if (onBodyCallback &&
+        !body.begin(inflater ? __INF__ : contentLength, opts->MaxMemoryBodyLength))
+        return HttpStatus::InternalServerError;
+    return HttpStatus::OK;
+}
+
+HttpStatus::Code HttpRequest::feedBody(std::string_view data, bool complete, bool& done)
+{
+    if (inflater) return inflateBody(data, complete, done);
+    return deliverBody(data, complete, done);
+}
+
+HttpStatus::Code HttpRequest::deliverBody(const std::string_view& data, bool complete, bool& done)
+{
+    if (onDataCallback) { done = onDataCallback(data) || complete; }
+    else if (onBodyCallback) {
+        if (complete && body.received() == 0)
+            // whole body is in one slice, hand it out without copying
+            onBodyCallback(data);
+        else {
+            if (!body.append(data)) return HttpStatus::InternalServerError;
+            if (complete) onBodyCallback(body.view());
+        }
+        done = complete;
+    }
+    else
+        done = complete;
+    return HttpStatus::OK;
+}
+
+// output goes out in fixed chunks from a per loop buffer, so memory stays flat however much the
+// body inflates to
+HttpStatus::Code HttpRequest::inflateBody(std::string_view data, bool complete, bool& done)
+{
+    static thread_local char chunk[64 * 1024];
+    bool                     full;
+    do {
+        auto [consumed, produced] = inflater->inflate(data, chunk, sizeof(chunk));
+        data.remove_prefix(consumed);
+        // checked before the end is delivered, a body with unparsed bytes left is never accepted
+        if (inflater->done() && !data.empty())
+            throw std::runtime_error("Data after the end of the compressed body");
+        full = produced == sizeof(chunk);
+        inflatedLength += produced;
+        if (inflatedLength > opts->MaxDecompressedLength) return HttpStatus::PayloadTooLarge;
+        // the callbacks only learn about the end once the stream and the body are both done
+        bool last = inflater->done() && complete;
+        if (produced > 0 || last) {
+            HttpStatus::Code status = deliverBody(std::string_view(chunk, produced), last, done);
+            if (status != HttpStatus::OK || done) return status;
+        }
+    } while (!inflater->done() && (full || !data.empty()));
+    if (inflater->done() && !complete)
+        throw std::runtime_error("Data after the end of the compressed body");
+    if (complete) throw std::runtime_error("Compressed body is truncated");
+    return HttpStatus::OK;
+}
+
 HttpRequest::~HttpRequest()
 {
-    for (auto [key, param] : params)
-        delete param;
-    params.clear();
+    Arena::destroy(multipart);
+    Inflater::release(inflater);
+    if (routeEpoch) Rcu::unpin(routeEpoch);
 }
 
 }; // namespace cW
\ No newline at end of file
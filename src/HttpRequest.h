@@ -2,11 +2,18 @@
 #define __CW_HTTP_REQUEST_H_
 
 #include <map>
+#include <memory_resource>
 #include <string>
 #include <cassert>
 #include <functional>
 #include <set>
 #include <stdexcept>
+#include "Arena.h"
+#include "BodyBuffer.h"
+#include "Compression.h"
+#include "HttpOpts.h"
+#include "HttpStatusCodes_C++.h"
+#include "Multipart.h"
 #include "UrlPath.h"
 
 namespace cW {
@@ -15,6 +22,10 @@ enum HttpMethod { UNSET, GET, POST, PUT, DEL, HEAD };
 
 class HttpRequest {
     friend class HttpSession;
+    friend class Http2Session;
+    friend class HttpResponse;
+    friend class ResponseCache;
+    friend class SingleFlight;
     friend class WebSocketSession;
     friend class Router;
 
@@ -25,20 +36,26 @@ class HttpRequest {
         bool operator()(const std::string_view& a, const std::string_view& b) const;
     };
 
+    // connection arena, reset once the request is done
+    Arena& memory;
+
     HttpMethod       method;
     std::string_view url;
     std::string_view absolutePath;
 
-    std::string data;
-    bool        inHandler = true;
+    BodyBuffer body;
+    bool       inHandler = true;
 
-    const UrlPath* urlPath;
+    const UrlPath*  urlPath;
+    const HttpOpts* opts = nullptr;
+    // epoch of the routing table the route came from, pinned until the request ends
+    uint64_t routeEpoch = 0;
 
-    std::string_view                       headerSection;
-    std::string_view                       querySection;
-    std::set<std::string_view, HeaderComp> headers;
-    std::set<std::string_view, QueryComp>  queries;
-    std::map<std::string_view, UrlParam*>  params;
+    std::string_view                            headerSection;
+    std::string_view                            querySection;
+    std::pmr::set<std::string_view, HeaderComp> headers;
+    std::pmr::set<std::string_view, QueryComp>  queries;
+    UrlParams                                   params;
 
     bool paramsParsed    = false;
     bool headersSplitted = false;
@@ -48,11 +65,27 @@ class HttpRequest {
 
     std::function<bool(std::string_view)> onDataCallback = nullptr;
     std::function<void(std::string_view)> onBodyCallback = nullptr;
+    MultipartParser*                      multipart      = nullptr;
+    // set when a compressed body is inflated before the callbacks see it
+    Inflater* inflater       = nullptr;
+    size_t    inflatedLength = 0;
     // only to be initialized when the headers have been fully received
-    HttpRequest(const std::string_view& requestHeader);
+    HttpRequest(Arena& arena, const std::string_view& requestHeader);
     void parse(const std::string_view& requestHeader);
 
     inline void getContentLength();
+    // trimmed header value, false if the header isn't there
+    bool findHeader(const std::string_view& key, std::string_view& value);
+    void splitQueries();
+
+    // sets up inflating and buffering once the handler attached its callbacks.
+    // returns the status to refuse the body with, OK normally
+    HttpStatus::Code beginBody();
+    // hands a slice of the body to the callbacks, done is set once they want nothing more.
+    // throws on corrupt compressed data
+    HttpStatus::Code feedBody(std::string_view data, bool complete, bool& done);
+    HttpStatus::Code deliverBody(const std::string_view& data, bool complete, bool& done);
+    HttpStatus::Code inflateBody(std::string_view data, bool complete, bool& done);
 
   public:
     ~HttpRequest();
@@ -60,6 +93,14 @@ class HttpRequest {
     HttpRequest* onData(std::function<bool(std::string_view)>&& onDataCallback);
     // callback for full request body
     HttpRequest* onBody(std::function<void(std::string_view)>&& onBodyCallback);
+    // multipart/form-data body parsed as it arrives, throws if the request isn't multipart
+    HttpRequest* onMultipart(MultipartParser::PartHandler&& onPart,
+                             MultipartParser::EndHandler&&  onEnd     = nullptr,
+                             MultipartParser::PartHandler&& onPartEnd = nullptr);
+    // scratch memory released with the request
+    inline Arena& arena() { return memory; }
+    // inside onBody: the temp file the body was spilled to, -1 if it is in memory
+    inline int bodyFile() const { return body.file(); }
 
     template <typename T = std::string_view>
         requires std::is_arithmetic_v<T> ||
@@ -96,22 +137,14 @@ template <typename T>
     assert(inHandler &&
            "Cannot access request information outside of route handler or inside data handler");
     static QueryComp queryComp;
-    if (!queriesSplitted) {
-        size_t len = querySection.size();
-        for (size_t i = 0; i < len;) {
-            size_t next = std::min(querySection.find('&', i), len);
-            queries.insert(querySection.substr(i, next - i));
-            i = next + 1;
-        }
-        queriesSplitted = true;
-    }
+    splitQueries();
     auto&& itr  = std::lower_bound(queries.begin(), queries.end(), key, queryComp);
     auto&& line = *itr;
     if (!queryComp(line, key)) {
         // equal
         size_t lineLen = line.size();
         size_t first = line.find('=') + 1, last = lineLen - 1;
-        char*  decoded = url_decode(line.data() + first, last - first + 1);
+        char*  decoded = url_decode(memory, line.data() + first, last - first + 1);
         T      ret;
         if constexpr (std::is_arithmetic_v<T>) {
             char* end;
@@ -121,9 +154,10 @@ template <typename T>
                 ret = (T)strtold(decoded, &end);
             if (*end) std::runtime_error("Query value is not arithmatic.");
         }
+        else if constexpr (std::is_same_v<T, std::string_view>)
+            ret = std::string_view(decoded); // valid until the request or ws handler ends
         else
             ret = std::string(decoded);
-        free(decoded);
         return ret;
     }
     else
@@ -137,11 +171,11 @@ template <typename T>
     assert(inHandler &&
            "Cannot access request information outside of route handler or inside data handler");
     if (!paramsParsed) {
-        params       = urlPath->parseParams(url);
+        urlPath->parseParams(absolutePath, params);
         paramsParsed = true;
     }
-    if (auto itr = params.find(key); itr != params.end())
-        return itr->second->get<T>();
+    if (const UrlParam* param = params.find(key))
+        return param->get<T>();
     else
         throw std::runtime_error("Asking for non-existent param");
 }
@@ -152,36 +186,18 @@ template <typename T>
 {
     assert(inHandler &&
            "Cannot access request information outside of route handler or inside data handler");
-    static HeaderComp headerComp;
-    if (!headersSplitted) {
-        size_t len = headerSection.size();
-        for (size_t i = 0; i < len;) {
-            size_t next = std::min(headerSection.find("\r\n", i), len);
-            headers.insert(headerSection.substr(i, next - i));
-            i = next + 2;
-        }
-        headersSplitted = true;
-    }
-    auto&& itr  = std::lower_bound(headers.begin(), headers.end(), key, headerComp);
-    auto&& line = *itr;
-    if (!headerComp(line, key)) {
-        // equal
-        size_t lineLen = line.size();
-        size_t first = line.find(':') + 1, last = lineLen - 1;
-        while (line[first] == ' ')
-            first++;
-        while (line[last] == ' ')
-            last--;
+    std::string_view value;
+    if (findHeader(key, value)) {
         if constexpr (std::is_arithmetic_v<T>) {
             char* end;
             if constexpr (std::is_integral_v<T>)
-                return (T)strtoll(line.data() + first, &end, 10);
+                return (T)strtoll(value.data(), &end, 10);
             else
-                return (T)strtold(line.data() + first, &end);
+                return (T)strtold(value.data(), &end);
             if (*end != '\r') std::runtime_error("Header value is not arithmatic.");
         }
         else
-            return (T)std::string_view(line.data() + first, last - first + 1);
+            return (T)value;
     }
     else
         throw std::runtime_error("Header not found");
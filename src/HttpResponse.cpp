@@ -1,15 +1,271 @@
 #include "HttpResponse.h"
 #include <iostream>
+#include "HttpRequest.h"
 
 namespace cW {
 
-HttpResponse::HttpResponse() {}
+HttpResponse::HttpResponse(Arena& arena, HttpRequest* request)
+    : memory(arena), request(request), sendBuffer(&arena), ranges(&arena), headers(&arena)
+{
+}
+
+HttpResponse::~HttpResponse()
+{
+    Deflater::release(deflater);
+    if (flight) SingleFlight::leave(this);
+}
+
+void HttpResponse::negotiate(const std::string_view& acceptEncoding, const HttpOpts* opts)
+{
+    this->opts     = opts;
+    encoding       = negotiateEncoding(acceptEncoding);
+    staticEncoding = negotiateEncoding(acceptEncoding, HasBrotli);
+    setHeader("Vary", "Accept-Encoding");
+}
+
+bool HttpResponse::shouldCompress(size_t size)
+{
+    return encoding != ContentEncoding::IDENTITY && size >= opts->MinCompressLength &&
+           !wroteContentLength && !headerSet("Content-Encoding");
+}
+
+void HttpResponse::beginStream(bool canCompress)
+{
+    // ranges are served from the identity body, only a producer can seek to them
+    compressStream = canCompress && onWritableCallback && encoding != ContentEncoding::IDENTITY &&
+                     (contentLength == __INF__ || contentLength >= opts->MinCompressLength) &&
+                     !headerSet("Content-Encoding") && !rangeRequested();
+    if (checkConditions(onWritableCallback ? contentLength : __INF__,
+                        compressStream ? encoding : ContentEncoding::IDENTITY)) {
+        compressStream = false;
+        return;
+    }
+    if (!ranges.empty()) {
+        // one span covering every range, the producer only moves forward
+        size_t size  = contentLength;
+        size_t first = ranges.front().first, last = ranges.front().last;
+        for (const ByteRange& range : ranges) {
+            first = std::min(first, range.first);
+            last  = std::max(last, range.last);
+        }
+        char contentRange[64];
+        int  len = snprintf(contentRange, sizeof(contentRange), "bytes %zu-%zu/%zu", first, last,
+                            size);
+        setHeader("Content-Range", std::string_view(contentRange, len));
+        removeHeader("Content-Length");
+        setHeader("Content-Length", last + 1 - first);
+        writeStart    = first;
+        contentLength = last + 1;
+    }
+    if (!compressStream) return;
+    setHeader("Content-Encoding", encodingName(encoding));
+    setHeader("Transfer-Encoding", "chunked");
+}
+
+bool HttpResponse::rangeRequested()
+{
+    std::string_view range;
+    return request->method == HttpMethod::GET && request->findHeader("range", range);
+}
+
+bool HttpResponse::checkConditions(size_t size, ContentEncoding bodyEncoding)
+{
+    conditionsChecked = true;
+    if (!etag.empty()) {
+        // every encoding is its own representation, the suffix goes inside the quotes
+        if (bodyEncoding != ContentEncoding::IDENTITY) {
+            std::string_view name = encodingName(bodyEncoding);
+            char*            tag  = (char*)memory.alloc(etag.size() + name.size() + 1, 1);
+            size_t           len  = etag.size() - 1;
+            std::memcpy(tag, etag.data(), len);
+            tag[len] = '-';
+            std::memcpy(tag + len + 1, name.data(), name.size());
+            tag[len + 1 + name.size()] = '"';
+            etag = std::string_view(tag, etag.size() + name.size() + 1);
+        }
+        setHeader("ETag", etag);
+    }
+    if (lastModified >= 0) {
+        char date[30];
+        setHeader("Last-Modified", formatHttpDate(lastModified, date));
+    }
+    if (size < __INF__ && bodyEncoding == ContentEncoding::IDENTITY)
+        setHeader("Accept-Ranges", "bytes");
+    // preconditions only guard a successful response
+    if (statusCode != HttpStatus::OK) return false;
+
+    std::string_view value;
+    time_t           date;
+    bool             safe = request->method == HttpMethod::GET || request->method == HttpMethod::HEAD;
+    // RFC 9110 13.2.2 order
+    if (request->findHeader("if-match", value)) {
+        if (!etagMatches(value, etag, false)) return answer(HttpStatus::PreconditionFailed), true;
+    }
+    else if (lastModified >= 0 && request->findHeader("if-unmodified-since", value) &&
+             parseHttpDate(value, date) && lastModified > date)
+        return answer(HttpStatus::PreconditionFailed), true;
+    if (request->findHeader("if-none-match", value)) {
+        if (etagMatches(value, etag, true))
+            return answer(safe ? HttpStatus::NotModified : HttpStatus::PreconditionFailed), true;
+    }
+    else if (safe && lastModified >= 0 && request->findHeader("if-modified-since", value) &&
+             parseHttpDate(value, date) && lastModified <= date)
+        return answer(HttpStatus::NotModified), true;
+
+    if (request->method != HttpMethod::GET || size == __INF__ ||
+        bodyEncoding != ContentEncoding::IDENTITY || !request->findHeader("range", value))
+        return false;
+    std::string_view ifRange;
+    if (request->findHeader("if-range", ifRange)) {
+        // only a strong validator can say the client's partial copy is still good
+        bool fresh = ifRange.starts_with('"')
+                         ? !etag.empty() && !etag.starts_with("W/") && ifRange == etag
+                         : lastModified >= 0 && parseHttpDate(ifRange, date) && date == lastModified;
+        if (!fresh) return false;
+    }
+    if (!parseRange(value, size, ranges)) {
+        ranges.clear();
+        return false;
+    }
+    if (ranges.empty()) {
+        char contentRange[32];
+        int  len = snprintf(contentRange, sizeof(contentRange), "bytes */%zu", size);
+        answer(HttpStatus::RangeNotSatisfiable);
+        setHeader("Content-Range", std::string_view(contentRange, len));
+        return true;
+    }
+    statusCode = HttpStatus::PartialContent;
+    return false;
+}
+
+void HttpResponse::answer(HttpStatus::Code status)
+{
+    statusCode         = status;
+    onWritableCallback = nullptr;
+    buffer             = std::string_view(nullptr, 0);
+    removeHeader("Content-Length");
+    removeHeader("Content-Encoding");
+    removeHeader("Transfer-Encoding");
+    // a 304 describes the body it didn't send, the others really are empty
+    if (status != HttpStatus::NotModified) setHeader("Content-Length", 0);
+    contentLength = 0;
+}
+
+std::string_view HttpResponse::rangeBody(const std::string_view& data, bool persistent)
+{
+    char header[96];
+    int  len;
+    if (ranges.size() == 1) {
+        const ByteRange& range = ranges.front();
+        len = snprintf(header, sizeof(header), "bytes %zu-%zu/%zu", range.first, range.last,
+                       data.size());
+        setHeader("Content-Range", std::string_view(header, len));
+        std::string_view body = data.substr(range.first, range.last + 1 - range.first);
+        if (persistent) return body;
+        sendBuffer = body;
+        return sendBuffer;
+    }
+    static thread_local uint64_t counter = 0;
+    char                         boundary[24];
+    int boundaryLength = snprintf(boundary, sizeof(boundary), "%016llx",
+                                  (unsigned long long)(++counter ^ (uintptr_t)this));
+    std::string_view contentType;
+    for (auto& [name, value] : headers)
+        if (ci_match<true>(name, "content-type")) contentType = value;
+    sendBuffer.clear();
+    for (const ByteRange& range : ranges) {
+        sendBuffer += "\r\n--";
+        sendBuffer.append(boundary, boundaryLength);
+        sendBuffer += "\r\n";
+        if (!contentType.empty()) {
+            sendBuffer += "Content-Type: ";
+            sendBuffer += contentType;
+            sendBuffer += "\r\n";
+        }
+        len = snprintf(header, sizeof(header), "Content-Range: bytes %zu-%zu/%zu\r\n\r\n",
+                       range.first, range.last, data.size());
+        sendBuffer.append(header, len);
+        sendBuffer += data.substr(range.first, range.last + 1 - range.first);
+    }
+    sendBuffer += "\r\n--";
+    sendBuffer.append(boundary, boundaryLength);
+    sendBuffer += "--\r\n";
+    removeHeader("Content-Type");
+    len = snprintf(header, sizeof(header), "multipart/byteranges; boundary=%.*s", boundaryLength,
+                   boundary);
+    setHeader("Content-Type", std::string_view(header, len));
+    return sendBuffer;
+}
+
+void HttpResponse::removeHeader(const std::string_view& name)
+{
+    for (auto itr = headers.begin(); itr != headers.end();)
+        itr = ci_match(itr->first, name) ? headers.erase(itr) : std::next(itr);
+    if (ci_match<true>(name, "content-length")) wroteContentLength = false;
+}
+
+bool HttpResponse::cacheable()
+{
+    return !cacheKey.empty() && !cached && statusCode == HttpStatus::OK && !onWritableCallback &&
+           !close && ranges.empty() && contentLength == buffer.size() && !headerSet("Set-Cookie");
+}
+
+void HttpResponse::share()
+{
+    if (cacheable()) cached = ResponseCache::store(this);
+    if (leader) SingleFlight::land(this, cached);
+}
+
+void HttpResponse::replay()
+{
+    std::string_view header = std::string_view(cached->data).substr(0, cached->headerLength);
+    statusCode              = cached->status;
+    headers.clear();
+    // skip the status line, every other line is "name: value"
+    size_t i = header.find("\r\n") + 2;
+    while (i + 2 < header.size()) {
+        size_t           next = header.find("\r\n", i);
+        std::string_view line = header.substr(i, next - i);
+        size_t           colon = line.find(':');
+        headers.emplace(line.substr(0, colon), line.substr(colon + 2));
+        i = next + 2;
+    }
+    buffer             = std::string_view(cached->data).substr(cached->headerLength);
+    contentLength      = buffer.size();
+    wroteContentLength = true;
+    conditionsChecked  = true;
+}
 
 HttpResponse* HttpResponse::onWritable(WriteHandler&& handler)
 {
     onWritableCallback = std::move(handler);
     return this;
 }
+HttpResponse* HttpResponse::onWritable(WriteHandler&& handler, size_t contentLength)
+{
+    setHeader("Content-Length", contentLength);
+    return onWritable(std::move(handler));
+}
+HttpResponse* HttpResponse::setETag(const std::string_view& tag, bool weak)
+{
+    char*  quoted = (char*)memory.alloc(tag.size() + 4, 1);
+    size_t len    = 0;
+    if (weak) {
+        quoted[len++] = 'W';
+        quoted[len++] = '/';
+    }
+    quoted[len++] = '"';
+    std::memcpy(quoted + len, tag.data(), tag.size());
+    len += tag.size();
+    quoted[len++] = '"';
+    etag          = std::string_view(quoted, len);
+    return this;
+}
+HttpResponse* HttpResponse::setLastModified(time_t time)
+{
+    lastModified = time;
+    return this;
+}
 HttpResponse* HttpResponse::onAborted(AbortHandler&& handler)
 {
     onAbortCallback = std::move(handler);
@@ -18,34 +274,68 @@ HttpResponse* HttpResponse::onAborted(AbortHandler&& handler)
 
 void HttpResponse::write(const std::string_view& data, size_t contentSize)
 {
-    buffer      = data;
-    contentSize = contentSize;
-    if (!wroteContentLength && contentSize < __INF__) {
-        setHeader("Content-Length", this->contentLength);
-        wroteContentLength = true;
-    }
+    buffer = data;
+    // a declared length (or range) wins over what the producer reports
+    if (!wroteContentLength && contentSize < __INF__) setHeader("Content-Length", contentSize);
 }
 
 void HttpResponse::write(const char* buf, size_t size, size_t contentSize)
 {
-    buffer      = std::string_view(buf, size);
-    contentSize = contentSize;
-    if (!wroteContentLength && contentSize < __INF__) {
-        setHeader("Content-Length", this->contentLength);
-        wroteContentLength = true;
+    buffer = std::string_view(buf, size);
+    if (!wroteContentLength && contentSize < __INF__) setHeader("Content-Length", contentSize);
+}
+
+void HttpResponse::send(const std::string_view& data)
+{
+    assert(!onWritableCallback && "Cannot attach write handler and then send data");
+    // conditions first, a 304 never pays for compression
+    bool compress = shouldCompress(data.size()) && !rangeRequested();
+    if (checkConditions(data.size(), compress ? encoding : ContentEncoding::IDENTITY)) return;
+    if (!ranges.empty()) {
+        buffer = rangeBody(data, false);
+        removeHeader("Content-Length");
     }
+    else if (compress) {
+        // one shot, the pooled stream goes straight back
+        Deflater* deflater = Deflater::acquire(encoding, opts->CompressionLevel);
+        size_t    bound    = deflater->bound(data.size());
+        char*     out      = (char*)memory.alloc(bound, 1);
+        auto [consumed, produced] = deflater->compress(data, out, bound, Z_FINISH);
+        Deflater::release(deflater);
+        setHeader("Content-Encoding", encodingName(encoding));
+        buffer = std::string_view(out, produced);
+    }
+    else {
+        sendBuffer = data;
+        buffer     = sendBuffer;
+    }
+    this->contentLength = buffer.size();
+    if (!wroteContentLength) setHeader("Content-Length", this->contentLength);
 }
 
-void HttpResponse::send(const std::string& data)
+void HttpResponse::sendStatic(const std::string_view& data)
 {
     assert(!onWritableCallback && "Cannot attach write handler and then send data");
-    this->contentLength = data.size();
-    if (!wroteContentLength) {
-        setHeader("Content-Length", this->contentLength);
-        wroteContentLength = true;
+    buffer = data;
+    // hashed every time, the same address can hold different content later
+    if (etag.empty()) etag = strongETag(data, (char*)memory.alloc(40, 1));
+    ContentEncoding bodyEncoding = ContentEncoding::IDENTITY;
+    if (staticEncoding != ContentEncoding::IDENTITY && data.size() >= opts->MinCompressLength &&
+        !wroteContentLength && !headerSet("Content-Encoding") && !rangeRequested()) {
+        cachedBody = CompressionCache::get(data, staticEncoding, opts->CompressionLevel);
+        if (cachedBody && cachedBody->size() < data.size()) bodyEncoding = staticEncoding;
+    }
+    if (checkConditions(data.size(), bodyEncoding)) return;
+    if (!ranges.empty()) {
+        buffer = rangeBody(data, true);
+        removeHeader("Content-Length");
+    }
+    else if (bodyEncoding != ContentEncoding::IDENTITY) {
+        setHeader("Content-Encoding", encodingName(bodyEncoding));
+        buffer = *cachedBody;
     }
-    sendBuffer = data;
-    buffer     = sendBuffer;
+    this->contentLength = buffer.size();
+    if (!wroteContentLength) setHeader("Content-Length", this->contentLength);
 }
 HttpResponse* HttpResponse::setStatus(HttpStatus::Code statusCode)
 {
@@ -1,15 +1,30 @@
 #ifndef __CW_HTTP_RESPONSE_H_
 #define __CW_HTTP_RESPONSE_H_
 
+#include <charconv>
 #include <functional>
 #include <map>
+#include <memory_resource>
+#include "Arena.h"
+#include "Compression.h"
+#include "Conditional.h"
+#include "HttpOpts.h"
+#include "ResponseCache.h"
+#include "SingleFlight.h"
 #include "Utils.h"
 #include "HttpStatusCodes_C++.h"
 
 namespace cW {
 
+class HttpRequest;
+struct HttpRoute;
+
 class HttpResponse {
     friend class HttpSession;
+    friend class Http2Session;
+    friend class Router;
+    friend class ResponseCache;
+    friend class SingleFlight;
 
     typedef std::function<void(void)>   AbortHandler;
     typedef std::function<void(size_t)> WriteHandler;
@@ -19,22 +34,80 @@ class HttpResponse {
 
     HttpStatus::Code statusCode = HttpStatus::OK;
 
+    Arena&       memory;
+    HttpRequest* request;
+
     std::string_view buffer;
     // send buffer should persist after send call
-    std::string sendBuffer;
+    std::pmr::string sendBuffer;
+    // keeps a precompressed static body alive
+    CompressionCache::Entry cachedBody;
+
+    const HttpOpts* opts = nullptr;
+    // what the client accepts, brotli only counts for static bodies
+    ContentEncoding encoding       = ContentEncoding::IDENTITY;
+    ContentEncoding staticEncoding = ContentEncoding::IDENTITY;
+    // onWritable output compressed on the fly and sent chunked
+    bool      compressStream = false;
+    Deflater* deflater       = nullptr;
 
     bool wroteContentLength = false;
     bool close              = false;
 
     size_t contentLength = __INF__;
 
-    std::multimap<std::string_view, std::string> headers;
+    // validators, the etag is kept quoted
+    std::string_view etag;
+    time_t           lastModified = -1;
+    // ranges being served, onWritable output starts at writeStart
+    std::pmr::vector<ByteRange> ranges;
+    size_t                      writeStart        = 0;
+    bool                        conditionsChecked = false;
+
+    // micro-cache entry being replayed, or the key a fresh response is stored under
+    ResponseCache::Entry cached;
+    std::string_view     cacheKey;
+    size_t               cacheTTL = 0;
+    // flight this request leads or follows, a follower falls back to the route handler when
+    // the leader's response can't be shared
+    SingleFlight::Flight flight;
+    bool                 leader = false;
+    const HttpRoute*     route  = nullptr;
+
+    std::pmr::multimap<std::string_view, std::pmr::string> headers;
+
+    HttpResponse(Arena& arena, HttpRequest* request);
+
+    void negotiate(const std::string_view& acceptEncoding, const HttpOpts* opts);
+    bool shouldCompress(size_t size);
+    // settles validators, ranges and compression for onWritable responses before the handler
+    // is first called
+    void beginStream(bool canCompress);
+
+    bool rangeRequested();
+    // evaluates the request preconditions and Range against a body of size bytes (__INF__ when
+    // unknown). true if the response was answered without a body and nothing should be produced
+    bool checkConditions(size_t size, ContentEncoding bodyEncoding);
+    void answer(HttpStatus::Code status);
+    // single range as a slice of data, several as multipart/byteranges in sendBuffer
+    std::string_view rangeBody(const std::string_view& data, bool persistent);
+    void             removeHeader(const std::string_view& name);
+    // producers may hand over more than the remaining length
+    inline void trimBuffer(size_t offset);
 
-    HttpResponse();
+    // a complete 200 with its body in hand, nothing that depends on the connection
+    bool cacheable();
+    // fills status, headers and body back in from the cached entry, for http/2
+    void replay();
+    // right before the header goes out: caches the response and hands it to its followers
+    void share();
 
   public:
+    ~HttpResponse();
+
     template <typename T>
-        requires std::is_convertible_v<T, std::string> || requires(T a)
+        requires std::is_convertible_v<T, std::string_view> ||
+        std::is_convertible_v<T, std::string> || requires(T a)
     {
         std::to_string(a);
     }
@@ -42,20 +115,41 @@ class HttpResponse {
     HttpResponse* setStatus(HttpStatus::Code statusCode);
     void          write(const char* buf, size_t size, size_t contentSize = __INF__);
     void          write(const std::string_view& data, size_t contentSize = __INF__);
-    void          send(const std::string& data);
+    void          send(const std::string_view& data);
+    // data must outlive the server, its compressed forms are cached across requests
+    void          sendStatic(const std::string_view& data);
     void          end();
     HttpResponse* onAborted(AbortHandler&& handler);
     HttpResponse* onWritable(WriteHandler&& handler);
+    // length known up front, lets conditional and range requests skip the handler entirely
+    HttpResponse* onWritable(WriteHandler&& handler, size_t contentLength);
+    // validators for If-None-Match/If-Match/If-Range, the tag is quoted here
+    HttpResponse* setETag(const std::string_view& tag, bool weak = false);
+    HttpResponse* setLastModified(time_t time);
     inline bool   headerSet(const std::string_view& name);
+    // nothing was sent or attached yet
+    inline bool pending() const;
 };
 
+bool HttpResponse::pending() const
+{
+    return !cached && !onWritableCallback && buffer.empty() && contentLength == __INF__ && !close;
+}
+
+void HttpResponse::trimBuffer(size_t offset)
+{
+    if (contentLength < __INF__)
+        buffer = buffer.substr(0, contentLength - std::min(offset, contentLength));
+}
+
 bool HttpResponse::headerSet(const std::string_view& name)
 {
     return headers.find(name) != headers.end();
 }
 
 template <typename T>
-    requires std::is_convertible_v<T, std::string> || requires(T a)
+    requires std::is_convertible_v<T, std::string_view> ||
+    std::is_convertible_v<T, std::string> || requires(T a)
 {
     std::to_string(a);
 }
@@ -64,12 +158,22 @@ HttpResponse* HttpResponse::setHeader(const std::string_view& name, const T& val
     // std::string key = to_lower(name);
     if (ci_match<true>(name, "content-length")) {
         wroteContentLength = true;
-        contentLength      = (size_t)value;
+        if constexpr (std::is_arithmetic_v<T>)
+            contentLength = (size_t)value;
+        else if constexpr (std::is_convertible_v<T, std::string_view>) {
+            std::string_view str(value);
+            std::from_chars(str.data(), str.data() + str.size(), contentLength);
+        }
+    }
+    if constexpr (std::is_convertible_v<T, std::string_view>)
+        headers.emplace(name, std::string_view(value));
+    else if constexpr (std::is_convertible_v<T, std::string>)
+        headers.emplace(name, std::string(value));
+    else {
+        char buf[32];
+        auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+        headers.emplace(name, std::string_view(buf, end - buf));
     }
-    if constexpr (std::is_convertible_v<T, std::string>)
-        headers.insert({name, value});
-    else
-        headers.insert({name, std::to_string(value)});
     return this;
 }
 }; // namespace cW
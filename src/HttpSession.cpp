@@ -13,13 +13,22 @@ HttpSession::HttpSession(ClientSocket* socket, const std::string_view& requestHe
 
 void HttpSession::dispatch(const std::string_view& requestHeader)
 {
-    request  = new HttpRequest(requestHeader);
-    response = new HttpResponse();
+    Arena& arena = socket->arena;
+    request      = new (arena.alloc(sizeof(HttpRequest), alignof(HttpRequest)))
+        HttpRequest(arena, requestHeader);
+    response = new (arena.alloc(sizeof(HttpResponse), alignof(HttpResponse)))
+        HttpResponse(arena, request);
     // Clock::printElapsed("Dispatching.");
     // reset write state
     if (hasHandler = socket->server->dispatch(request, response)) {
-        if (request->onBodyCallback) request->data.reserve(request->contentLength);
         request->inHandler = false;
+        doneReceiving      = request->contentLength == 0;
+        // never size anything from the client's content-length before checking it
+        if (request->contentLength > request->opts->MaxBodyLength)
+            reject(HttpStatus::PayloadTooLarge);
+        else if (HttpStatus::Code status; !doneReceiving &&
+                 (status = request->beginBody()) != HttpStatus::OK)
+            reject(status);
     }
     else
         socket->connected = false;
@@ -31,28 +40,33 @@ bool HttpSession::shouldEnd()
            (socket->writeBuffer.empty() && doneReceiving && (response->close || doneWriting));
 }
 
-void HttpSession::badRequest()
+void HttpSession::badRequest() { reject(HttpStatus::BadRequest); }
+
+// answers in place of the handler and drops the connection, the rest of the body is never read
+void HttpSession::reject(HttpStatus::Code status)
 {
     response->close = true;
-    socket->writeBuffer += ("HTTP/1.1 " + HttpStatus::status(HttpStatus::BadRequest) + "\r\n\r\n");
+    doneReceiving   = true;
+    socket->writeBuffer += ("HTTP/1.1 " + HttpStatus::status(status) +
+                            "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
     size_t len  = socket->writeBuffer.size();
     doneWriting = len == socket->write(nullptr, 0, true);
+    wroteHeader = true;
+    socket->disconnect();
 }
 
-void HttpSession::onData(const std::string_view& data)
+void HttpSession::onData(const std::string_view& recvBuf)
 {
+    if (doneReceiving) return;
+    // bytes past the declared length are not part of this body
+    std::string_view data =
+        recvBuf.substr(0, std::min(recvBuf.size(), request->contentLength - bodyReceived));
+    bodyReceived += data.size();
+    bool complete = bodyReceived >= request->contentLength;
     try {
-        if (request->onDataCallback) { doneReceiving = request->onDataCallback(data); }
-        else if (request->onBodyCallback) {
-            request->data.append(data);
-            if (request->contentLength <= request->data.size()) {
-                request->onBodyCallback(request->data);
-                request->data.clear();
-                doneReceiving = true;
-            }
-        }
-        else
-            doneReceiving = true;
+        HttpStatus::Code status = request->feedBody(data, complete, doneReceiving);
+        if (status != HttpStatus::OK) return reject(status);
+        socket->wantWrite = true;
     }
     catch (std::runtime_error& error) {
         std::cerr << error.what() << std::endl;
@@ -62,12 +76,52 @@ void HttpSession::onData(const std::string_view& data)
 
 void HttpSession::onWritable()
 {
+    // following another request for the same key, the socket sleeps until it answers
+    if (!wroteHeader && response->flight && SingleFlight::wait(request, response, socket)) {
+        socket->wantWrite = false;
+        return;
+    }
+    if (!wroteHeader && response->pending() && !doneReceiving &&
+        (request->onDataCallback || request->onBodyCallback)) {
+        // handler answers from a body callback, wait for it. one that attached nothing gets the
+        // empty response
+        socket->wantWrite = false;
+        return;
+    }
+    // the handler answered nothing, that is an empty 200 and the connection stays open
+    if (!wroteHeader && response->pending()) response->send(std::string_view());
+    if (!wroteHeader) response->share();
+    if (!wroteHeader && response->cached) {
+        // status line, headers and body leave in a single write
+        socket->write(response->cached->data, true);
+        wroteHeader = doneWriting = response->conditionsChecked = true;
+        return;
+    }
+    if (!response->conditionsChecked) {
+        // a 304 or 416 is settled before the producer would run
+        response->beginStream(true);
+        writeOffset = response->writeStart;
+    }
+    if (response->onWritableCallback) {
+        try {
+            response->onWritableCallback(writeOffset);
+            response->trimBuffer(writeOffset);
+        }
+        catch (std::runtime_error& error) {
+            std::cerr << error.what() << std::endl;
+            if (!wroteHeader) return badRequest();
+        }
+    }
+    bool headerOnly = false;
     if (!wroteHeader) {
         // assert(socket->writeBuffer.size() == 0 && "How is size not zero here?");
+        // the first callback round may still set headers or the content length
         socket->write("HTTP/1.1 ");
         socket->write(HttpStatus::status(response->statusCode));
         socket->write("\r\n");
         for (auto [name, value] : response->headers) {
+            // chunked instead, the compressed length isn't known up front
+            if (response->compressStream && ci_match<true>(name, "content-length")) continue;
             socket->write(name);
             socket->write(": ");
             socket->write(value);
@@ -75,17 +129,19 @@ void HttpSession::onWritable()
         }
         socket->write("\r\n");
         wroteHeader = true;
+        headerOnly  = response->contentLength == 0;
     }
-    if (response->onWritableCallback) {
-        try {
-            response->onWritableCallback(writeOffset);
-        }
-        catch (std::runtime_error& error) {
-            std::cerr << error.what() << std::endl;
-            if (!wroteHeader) return badRequest();
-        }
+    if (response->compressStream && !doneWriting) {
+        // writeOffset keeps counting the uncompressed bytes the handler gave us
+        size_t bufferLength = response->buffer.length();
+        bool   final =
+            (writeOffset + bufferLength) >= response->contentLength || response->close;
+        if (bufferLength > 0 || final) writeCompressed(response->buffer, final);
+        writeOffset += bufferLength;
+        response->buffer = std::string_view(nullptr, 0);
+        doneWriting      = final;
     }
-    if (!response->buffer.empty()) {
+    else if (!response->buffer.empty()) {
         size_t bufferLength = response->buffer.length();
         bool   final        = (writeOffset + bufferLength) >= response->contentLength;
         writeOffset += socket->write(response->buffer.data(), bufferLength, final);
@@ -93,11 +149,38 @@ void HttpSession::onWritable()
         doneWriting      = writeOffset >= response->contentLength;
     }
     else {
-        if (!socket->writeBuffer.empty()) socket->write(nullptr, 0, true);
+        // a bodyless answer like a 304 still has its header sitting in the cork buffer
+        if (!socket->writeBuffer.empty() || headerOnly) socket->write(nullptr, 0, true);
         doneWriting = socket->writeBuffer.empty();
     }
 }
 
+// every byte is taken, whatever the socket can't send right away ends up in the write buffer
+void HttpSession::writeCompressed(std::string_view data, bool final)
+{
+    static thread_local char out[64 * 1024];
+    if (!response->deflater)
+        response->deflater =
+            Deflater::acquire(response->encoding, response->opts->CompressionLevel);
+    int  flush = final ? Z_FINISH : Z_SYNC_FLUSH;
+    bool full;
+    do {
+        auto [consumed, produced] = response->deflater->compress(data, out, sizeof(out), flush);
+        data.remove_prefix(consumed);
+        full = produced == sizeof(out);
+        if (produced > 0) {
+            char chunkSize[24];
+            int  len = snprintf(chunkSize, sizeof(chunkSize), "%zx\r\n", produced);
+            socket->write(std::string_view(chunkSize, len));
+            socket->write(std::string_view(out, produced));
+            socket->write("\r\n");
+        }
+    } while (full || !data.empty());
+    socket->write(final ? "0\r\n\r\n" : "", true);
+    // flushing clears wantWrite, the handler still has more to give
+    if (!final) socket->wantWrite = true;
+}
+
 void HttpSession::onAwakePre() {}
 void HttpSession::onAwakePost() {}
 
@@ -106,10 +189,11 @@ void HttpSession::onAborted()
     if (response->onAbortCallback) response->onAbortCallback();
 }
 
+// request and response are owned by the connection arena
 HttpSession::~HttpSession()
 {
-    delete request;
-    delete response;
+    Arena::destroy(request);
+    Arena::destroy(response);
 }
 
 } // namespace cW
\ No newline at end of file
@@ -22,10 +22,13 @@ class HttpSession : Session {
     bool          doneReceiving = true; // if no data is available, this is the default
     bool          dispatched    = false;
     bool          hasHandler;
+    size_t        bodyReceived = 0;
 
     HttpSession(ClientSocket* socket, const std::string_view& requestHeader);
     void dispatch(const std::string_view& requestHeader);
     void badRequest();
+    void reject(HttpStatus::Code status);
+    void writeCompressed(std::string_view data, bool final);
     void onAwakePre() override;
     void onAwakePost() override;
     void onAborted() override;
@@ -0,0 +1,91 @@
+#ifndef __CW_MIDDLEWARE_H_
+#define __CW_MIDDLEWARE_H_
+
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace cW {
+
+class HttpRequest;
+class HttpResponse;
+
+// a middleware is any object with one or both of
+//   bool before(HttpRequest*, HttpResponse*)  false once it answered itself, skipping the rest
+//   void after(HttpRequest*, HttpResponse*)   once the handler returned, in reverse order
+// chains are put together when a route is registered and stored as one type, so the whole
+// chain can be inlined into the route's call. Server::use middleware wraps every route instead
+// and costs an indirect call per hook
+template <typename Handler, typename... Middleware>
+class Chained {
+    std::tuple<Middleware...> middleware;
+    Handler                   handler;
+
+    template <size_t I, typename... Params>
+    inline void run(HttpRequest* request, HttpResponse* response, Params&... params)
+    {
+        if constexpr (I == sizeof...(Middleware))
+            handler(request, response, params...);
+        else {
+            auto& current = std::get<I>(middleware);
+            if constexpr (requires { current.before(request, response); })
+                if (!current.before(request, response)) return;
+            run<I + 1>(request, response, params...);
+            if constexpr (requires { current.after(request, response); })
+                current.after(request, response);
+        }
+    }
+
+  public:
+    Chained(const std::tuple<Middleware...>& middleware, Handler&& handler)
+        : middleware(middleware), handler(std::move(handler))
+    {
+    }
+
+    // typed routes pass their params through to the handler
+    template <typename... Params>
+    requires std::is_invocable_v<Handler&, HttpRequest*, HttpResponse*, Params...>
+    void operator()(HttpRequest* request, HttpResponse* response, Params... params)
+    {
+        run<0>(request, response, params...);
+    }
+};
+
+// middleware waiting for a handler, outermost first
+template <typename... Middleware>
+class Pipeline {
+    std::tuple<Middleware...> middleware;
+
+  public:
+    explicit Pipeline(Middleware... middleware) : middleware(std::move(middleware)...) {}
+
+    template <typename Handler>
+    Chained<std::decay_t<Handler>, Middleware...> operator()(Handler&& handler) const
+    {
+        return Chained<std::decay_t<Handler>, Middleware...>(
+            middleware, std::decay_t<Handler>(std::forward<Handler>(handler)));
+    }
+
+    // the same pipeline with more middleware inside it
+    template <typename... More>
+    Pipeline<Middleware..., std::decay_t<More>...> with(More&&... more) const
+    {
+        return std::apply(
+            [&](const Middleware&... outer) {
+                return Pipeline<Middleware..., std::decay_t<More>...>(
+                    outer..., std::decay_t<More>(std::forward<More>(more))...);
+            },
+            middleware);
+    }
+};
+
+// chain(Auth{}, Cors{})(handler) runs Auth, then Cors, then the handler
+template <typename... Middleware>
+Pipeline<std::decay_t<Middleware>...> chain(Middleware&&... middleware)
+{
+    return Pipeline<std::decay_t<Middleware>...>(std::forward<Middleware>(middleware)...);
+}
+
+}; // namespace cW
+
+#endif
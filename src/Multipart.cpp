@@ -0,0 +1,267 @@
+#include "Multipart.h"
+
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <stdexcept>
+#include "Utils.h"
+
+namespace cW {
+
+const size_t MultipartParser::MaxHeaderLength   = 8 * 1024;
+const size_t MultipartParser::MaxBoundaryLength = 70;
+
+void MultipartPart::reset(const std::string_view& headerSection)
+{
+    this->headerSection = headerSection;
+    onDataCallback      = nullptr;
+    fd                  = -1;
+}
+
+void MultipartPart::deliver(const std::string_view& data)
+{
+    if (fd >= 0) {
+        const char* buf  = data.data();
+        size_t      left = data.size();
+        while (left > 0) {
+            ssize_t wrote = ::write(fd, buf, left);
+            if (wrote < 0) {
+                if (errno == EINTR) continue;
+                perror("Couldn't write multipart data");
+                throw std::runtime_error("Multipart part write failed");
+            }
+            buf += wrote;
+            left -= wrote;
+        }
+    }
+    else if (onDataCallback)
+        onDataCallback(data);
+}
+
+MultipartPart* MultipartPart::onData(DataHandler&& handler)
+{
+    fd             = -1;
+    onDataCallback = std::move(handler);
+    return this;
+}
+
+MultipartPart* MultipartPart::pipeTo(int fd)
+{
+    onDataCallback = nullptr;
+    this->fd       = fd;
+    return this;
+}
+
+std::string_view MultipartPart::getHeader(const std::string_view& name) const
+{
+    size_t len = headerSection.size();
+    for (size_t i = 0; i < len;) {
+        size_t           next  = std::min(headerSection.find("\r\n", i), len);
+        std::string_view line  = headerSection.substr(i, next - i);
+        size_t           colon = line.find(':');
+        i                      = next + 2;
+        if (colon == std::string_view::npos || !ci_match(line.substr(0, colon), name)) continue;
+        size_t first = colon + 1, last = line.size();
+        while (first < last && (line[first] == ' ' || line[first] == '\t'))
+            first++;
+        while (last > first && (line[last - 1] == ' ' || line[last - 1] == '\t'))
+            last--;
+        return line.substr(first, last - first);
+    }
+    return std::string_view();
+}
+
+std::string_view MultipartPart::dispositionParam(const char* key) const
+{
+    std::string_view disposition = getHeader("content-disposition");
+    size_t           keyLen      = strlen(key);
+    for (size_t i = disposition.find(';'); i < disposition.size();) {
+        i++;
+        while (i < disposition.size() && disposition[i] == ' ')
+            i++;
+        size_t end = std::min(disposition.find(';', i), disposition.size());
+        if (ci_match(disposition.substr(i, keyLen), std::string_view(key, keyLen)) &&
+            i + keyLen < disposition.size() && disposition[i + keyLen] == '=') {
+            std::string_view value = disposition.substr(i + keyLen + 1);
+            if (!value.empty() && value[0] == '"') {
+                size_t quote = value.find('"', 1);
+                return value.substr(1, quote == std::string_view::npos ? quote : quote - 1);
+            }
+            return value.substr(0, end - (i + keyLen + 1));
+        }
+        i = end;
+    }
+    return std::string_view();
+}
+
+MultipartParser::MultipartParser(Arena&           arena,
+                                 std::string_view boundary,
+                                 PartHandler&&    onPart,
+                                 EndHandler&&     onEnd,
+                                 PartHandler&&    onPartEnd)
+    : onPartCallback(std::move(onPart)),
+      onPartEndCallback(std::move(onPartEnd)),
+      onEndCallback(std::move(onEnd))
+{
+    if (boundary.empty() || boundary.size() > MaxBoundaryLength)
+        throw std::runtime_error("Invalid multipart boundary");
+    delimiterLength = boundary.size() + 4;
+    delimiter       = (char*)arena.alloc(delimiterLength, 1);
+    std::memcpy(delimiter, "\r\n--", 4);
+    std::memcpy(delimiter + 4, boundary.data(), boundary.size());
+    headerBuffer = (char*)arena.alloc(MaxHeaderLength, 1);
+    // the first delimiter may come without the leading line break
+    std::memcpy(carry, "\r\n", 2);
+    carryLength = 2;
+}
+
+std::string_view MultipartParser::boundaryOf(const std::string_view& contentType)
+{
+    if (ci_find<true>(contentType, "multipart/") == __INF__) return std::string_view();
+    size_t start = ci_find<true>(contentType, "boundary=");
+    if (start == __INF__) return std::string_view();
+    std::string_view boundary = contentType.substr(start + 9);
+    boundary                  = boundary.substr(0, boundary.find(';'));
+    while (!boundary.empty() && boundary.back() == ' ')
+        boundary.remove_suffix(1);
+    if (boundary.size() >= 2 && boundary.front() == '"' && boundary.back() == '"')
+        boundary = boundary.substr(1, boundary.size() - 2);
+    return boundary;
+}
+
+void MultipartParser::emit(const std::string_view& data)
+{
+    // preamble is dropped
+    if (state == BODY && !data.empty()) part.deliver(data);
+}
+
+void MultipartParser::endPart()
+{
+    if (state == BODY && onPartEndCallback) onPartEndCallback(part);
+    state             = BOUNDARY_END;
+    boundaryEndLength = 0;
+}
+
+// start of the shortest tail of data that is a delimiter prefix, size if there is none
+size_t MultipartParser::partialMatch(const char* data, size_t size) const
+{
+    size_t from = size > delimiterLength - 1 ? size - (delimiterLength - 1) : 0;
+    for (size_t i = from; i < size; i++) {
+        const char* cr = (const char*)memchr(data + i, delimiter[0], size - i);
+        if (!cr) break;
+        i = cr - data;
+        if (std::memcmp(data + i, delimiter, size - i) == 0) return i;
+    }
+    return size;
+}
+
+size_t MultipartParser::consumeCarry(const std::string_view& data)
+{
+    char   window[sizeof(carry) + MaxBoundaryLength + 4];
+    size_t oldCarry = carryLength;
+    size_t extra    = std::min(data.size(), delimiterLength);
+    std::memcpy(window, carry, oldCarry);
+    std::memcpy(window + oldCarry, data.data(), extra);
+    size_t windowLength = oldCarry + extra;
+    carryLength         = 0;
+
+    size_t pos = find_bytes(window, windowLength, delimiter, delimiterLength);
+    if (pos < oldCarry) {
+        emit(std::string_view(window, pos));
+        endPart();
+        return pos + delimiterLength - oldCarry;
+    }
+    size_t keep = partialMatch(window, windowLength);
+    if (keep < oldCarry && extra == data.size()) {
+        // still can't tell, keep everything that might be a delimiter
+        emit(std::string_view(window, keep));
+        carryLength = windowLength - keep;
+        std::memcpy(carry, window + keep, carryLength);
+        return data.size();
+    }
+    emit(std::string_view(window, oldCarry));
+    return 0;
+}
+
+size_t MultipartParser::parseBody(const std::string_view& data)
+{
+    if (carryLength) {
+        size_t used = consumeCarry(data);
+        if (used || carryLength) return used;
+    }
+    size_t pos = find_bytes(data.data(), data.size(), delimiter, delimiterLength);
+    if (pos != std::string_view::npos) {
+        emit(data.substr(0, pos));
+        endPart();
+        return pos + delimiterLength;
+    }
+    size_t keep = partialMatch(data.data(), data.size());
+    emit(data.substr(0, keep));
+    carryLength = data.size() - keep;
+    std::memcpy(carry, data.data() + keep, carryLength);
+    return data.size();
+}
+
+size_t MultipartParser::parseBoundaryEnd(const std::string_view& data)
+{
+    size_t i = 0;
+    // transport padding
+    while (boundaryEndLength == 0 && i < data.size() && (data[i] == ' ' || data[i] == '\t'))
+        i++;
+    while (boundaryEndLength < 2 && i < data.size())
+        boundaryEnd[boundaryEndLength++] = data[i++];
+    if (boundaryEndLength < 2) return i;
+    if (boundaryEnd[0] == '-' && boundaryEnd[1] == '-') {
+        state = DONE;
+        if (onEndCallback) onEndCallback();
+    }
+    else if (boundaryEnd[0] == '\r' && boundaryEnd[1] == '\n') {
+        state = HEADERS;
+        // leading line break so a part without headers still ends in an empty line
+        std::memcpy(headerBuffer, "\r\n", 2);
+        headerLength = 2;
+    }
+    else
+        throw std::runtime_error("Malformed multipart delimiter");
+    return i;
+}
+
+size_t MultipartParser::parseHeaders(const std::string_view& data)
+{
+    size_t oldLength = headerLength;
+    size_t toCopy    = std::min(data.size(), MaxHeaderLength - headerLength);
+    std::memcpy(headerBuffer + headerLength, data.data(), toCopy);
+    headerLength += toCopy;
+
+    size_t from = oldLength > 3 ? oldLength - 3 : 0;
+    size_t end  = find_bytes(headerBuffer + from, headerLength - from, "\r\n\r\n", 4);
+    if (end == std::string_view::npos) {
+        if (headerLength == MaxHeaderLength)
+            throw std::runtime_error("Multipart part headers too large");
+        return toCopy;
+    }
+    end += from;
+    // keep the line break of the last header
+    part.reset(std::string_view(headerBuffer + 2, end));
+    state = BODY;
+    if (onPartCallback) onPartCallback(part);
+    return end + 4 - oldLength;
+}
+
+bool MultipartParser::feed(std::string_view data)
+{
+    while (!data.empty() && state != DONE) {
+        size_t used = 0;
+        switch (state) {
+            case PREAMBLE:
+            case BODY: used = parseBody(data); break;
+            case BOUNDARY_END: used = parseBoundaryEnd(data); break;
+            case HEADERS: used = parseHeaders(data); break;
+            case DONE: break;
+        }
+        data.remove_prefix(used);
+    }
+    return state == DONE;
+}
+
+}; // namespace cW
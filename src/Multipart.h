@@ -0,0 +1,100 @@
+#ifndef __CW_MULTIPART_H_
+#define __CW_MULTIPART_H_
+
+#include <functional>
+#include <string_view>
+#include "Arena.h"
+
+namespace cW {
+
+class MultipartParser;
+
+// one part of a multipart/form-data body, the same object is reused for every part
+class MultipartPart {
+    friend class MultipartParser;
+
+    typedef std::function<void(std::string_view)> DataHandler;
+
+    std::string_view headerSection;
+    DataHandler      onDataCallback = nullptr;
+    int              fd             = -1;
+
+    void deliver(const std::string_view& data);
+    void reset(const std::string_view& headerSection);
+
+    std::string_view dispositionParam(const char* key) const;
+
+  public:
+    // empty if the header isn't there
+    std::string_view getHeader(const std::string_view& name) const;
+    // form field name and file name from content-disposition
+    inline std::string_view name() const { return dispositionParam("name"); }
+    inline std::string_view filename() const { return dispositionParam("filename"); }
+
+    // part data as it arrives, slices point into the receive buffer when possible
+    MultipartPart* onData(DataHandler&& handler);
+    // write part data straight to a file descriptor instead
+    MultipartPart* pipeTo(int fd);
+};
+
+// incremental multipart/form-data parser, memory use is bounded by the header limit no matter how
+// large the parts are
+class MultipartParser {
+  public:
+    typedef std::function<void(MultipartPart&)> PartHandler;
+    typedef std::function<void(void)>           EndHandler;
+
+  private:
+    enum State { PREAMBLE, BOUNDARY_END, HEADERS, BODY, DONE };
+
+    static const size_t MaxHeaderLength;
+    static const size_t MaxBoundaryLength;
+
+    // "\r\n--" + boundary
+    char*  delimiter;
+    size_t delimiterLength;
+
+    State state = PREAMBLE;
+
+    // delimiter prefix left over at the end of the last chunk
+    char   carry[80];
+    size_t carryLength = 0;
+
+    // pending "--" or "\r\n" after a delimiter
+    char   boundaryEnd[2];
+    size_t boundaryEndLength = 0;
+
+    char*  headerBuffer;
+    size_t headerLength = 0;
+
+    MultipartPart part;
+    PartHandler   onPartCallback;
+    PartHandler   onPartEndCallback;
+    EndHandler    onEndCallback;
+
+    void   emit(const std::string_view& data);
+    size_t partialMatch(const char* data, size_t size) const;
+    // bytes consumed, npos if the delimiter wasn't completed
+    size_t consumeCarry(const std::string_view& data);
+    size_t parseBoundaryEnd(const std::string_view& data);
+    size_t parseHeaders(const std::string_view& data);
+    size_t parseBody(const std::string_view& data);
+    void   endPart();
+
+  public:
+    MultipartParser(Arena&           arena,
+                    std::string_view boundary,
+                    PartHandler&&    onPart,
+                    EndHandler&&     onEnd,
+                    PartHandler&&    onPartEnd = nullptr);
+
+    // returns true once the closing delimiter was seen, throws on malformed input
+    bool feed(std::string_view data);
+
+    // boundary parameter of a multipart content-type, empty if there is none
+    static std::string_view boundaryOf(const std::string_view& contentType);
+};
+
+}; // namespace cW
+
+#endif
@@ -0,0 +1,280 @@
+#include "PerMessageDeflate.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include "Utils.h"
+
+namespace cW {
+
+namespace {
+// every message ends in an empty stored block once flushed, the frame leaves it out
+const char Tail[4] = {0x00, 0x00, (char)0xff, (char)0xff};
+
+// zlib allocations with their size in front, added to the owner's count
+voidpf countedAlloc(voidpf opaque, uInt items, uInt size)
+{
+    size_t bytes = (size_t)items * size;
+    auto*  block = (std::max_align_t*)malloc(sizeof(std::max_align_t) + bytes);
+    if (!block) return Z_NULL;
+    *(size_t*)block = bytes;
+    *(size_t*)opaque += bytes;
+    return block + 1;
+}
+
+void countedFree(voidpf opaque, voidpf address)
+{
+    auto* block = (std::max_align_t*)address - 1;
+    *(size_t*)opaque -= *(size_t*)block;
+    free(block);
+}
+
+inline std::string_view trim(std::string_view str)
+{
+    while (!str.empty() && (str.front() == ' ' || str.front() == '\t'))
+        str.remove_prefix(1);
+    while (!str.empty() && (str.back() == ' ' || str.back() == '\t'))
+        str.remove_suffix(1);
+    return str;
+}
+
+// window bits are 8 to 15, but zlib can't produce a raw stream with a 256 byte window
+bool parseWindowBits(std::string_view value, int& bits)
+{
+    if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+        value = value.substr(1, value.size() - 2);
+    if (value.size() < 1 || value.size() > 2 || !std::all_of(value.begin(), value.end(), is_digit))
+        return false;
+    bits = std::atoi(std::string(value).c_str());
+    return bits >= 8 && bits <= 15;
+}
+
+// one offer like "permessage-deflate; client_max_window_bits", false if anything in it is unknown
+bool parseOffer(std::string_view offer, DeflateParams& offered, bool& clientBitsOffered)
+{
+    bool first = true;
+    for (size_t i = 0, len = offer.size(); i <= len;) {
+        size_t           next  = std::min(offer.find(';', i), len);
+        std::string_view param = trim(offer.substr(i, next - i));
+        i                      = next + 1;
+        size_t           eq    = param.find('=');
+        std::string_view name  = trim(param.substr(0, eq));
+        std::string_view value = eq == std::string_view::npos ? "" : trim(param.substr(eq + 1));
+        if (first) {
+            if (!ci_match<true>(name, "permessage-deflate") || !value.empty()) return false;
+            first = false;
+        }
+        else if (name == "server_no_context_takeover" && value.empty())
+            offered.serverNoContextTakeover = true;
+        else if (name == "client_no_context_takeover" && value.empty())
+            offered.clientNoContextTakeover = true;
+        else if (name == "server_max_window_bits") {
+            if (!parseWindowBits(value, offered.serverMaxWindowBits) ||
+                offered.serverMaxWindowBits == 8)
+                return false;
+        }
+        else if (name == "client_max_window_bits") {
+            if (!value.empty() && !parseWindowBits(value, offered.clientMaxWindowBits))
+                return false;
+            clientBitsOffered = true;
+        }
+        else
+            return false;
+    }
+    return true;
+}
+} // namespace
+
+bool negotiateDeflate(const std::string_view& extensions,
+                      const WebSocketOpts&    opts,
+                      DeflateParams&          params)
+{
+    if (opts.Compression == WsCompression::DISABLED) return false;
+    int windowBits = std::clamp(opts.CompressionWindowBits, 9, 15);
+    for (size_t i = 0, len = extensions.size(); i < len;) {
+        size_t        next = std::min(extensions.find(',', i), len);
+        DeflateParams offered;
+        bool          clientBitsOffered = false;
+        if (!parseOffer(extensions.substr(i, next - i), offered, clientBitsOffered)) {
+            i = next + 1;
+            continue;
+        }
+        params = offered;
+        params.serverNoContextTakeover |= opts.Compression == WsCompression::SHARED;
+        params.clientNoContextTakeover |= opts.ClientNoContextTakeover;
+        params.serverMaxWindowBits = std::min(offered.serverMaxWindowBits, windowBits);
+        // the client's window can only be bounded if it said it can take that
+        params.clientMaxWindowBits =
+            clientBitsOffered ? std::min(offered.clientMaxWindowBits, windowBits) : 15;
+        return true;
+    }
+    return false;
+}
+
+size_t formatDeflate(const DeflateParams& params, char* out)
+{
+    char* pos    = out;
+    auto  append = [&](const char* str) {
+        size_t len = strlen(str);
+        std::memcpy(pos, str, len);
+        pos += len;
+    };
+    append("permessage-deflate");
+    if (params.serverNoContextTakeover) append("; server_no_context_takeover");
+    if (params.clientNoContextTakeover) append("; client_no_context_takeover");
+    if (params.serverMaxWindowBits < 15) {
+        append("; server_max_window_bits=");
+        pos += sprintf(pos, "%d", params.serverMaxWindowBits);
+    }
+    if (params.clientMaxWindowBits < 15) {
+        append("; client_max_window_bits=");
+        pos += sprintf(pos, "%d", params.clientMaxWindowBits);
+    }
+    return pos - out;
+}
+
+WsDeflater::WsDeflater(int level, int windowBits, bool takeover) : takeover(takeover)
+{
+    std::memset(&stream, 0, sizeof(stream));
+    stream.zalloc = countedAlloc;
+    stream.zfree  = countedFree;
+    stream.opaque = &allocated;
+    // negative bits for raw deflate, hash tables shrink along with the window
+    int memLevel = std::clamp(windowBits - 7, 1, 8);
+    if (deflateInit2(&stream, level, Z_DEFLATED, -windowBits, memLevel, Z_DEFAULT_STRATEGY) !=
+        Z_OK)
+        throw std::runtime_error("Couldn't initialize deflate stream");
+}
+
+WsDeflater* WsDeflater::shared(int level, int windowBits)
+{
+    static thread_local std::unique_ptr<WsDeflater> compressors[10][16];
+    auto& compressor = compressors[std::clamp(level, 0, 9)][windowBits];
+    if (!compressor) compressor = std::make_unique<WsDeflater>(level, windowBits, false);
+    return compressor.get();
+}
+
+void WsDeflater::compress(const std::string_view& message, std::string& out)
+{
+    size_t start    = out.size();
+    stream.next_in  = (Bytef*)message.data();
+    stream.avail_in = (uInt)message.size();
+    out.resize(start + deflateBound(&stream, message.size()) + 8);
+    size_t produced = 0;
+    while (true) {
+        stream.next_out  = (Bytef*)out.data() + start + produced;
+        stream.avail_out = (uInt)(out.size() - start - produced);
+        deflate(&stream, Z_SYNC_FLUSH);
+        produced = out.size() - start - stream.avail_out;
+        // a flush that filled the output may have more to give
+        if (stream.avail_out) break;
+        out.resize(out.size() * 2);
+    }
+    assert(produced >= 4 && !std::memcmp(out.data() + start + produced - 4, Tail, 4) &&
+           "A sync flush ends in an empty stored block");
+    out.resize(start + produced - 4);
+    if (!takeover) deflateReset(&stream);
+}
+
+WsDeflater::~WsDeflater() { deflateEnd(&stream); }
+
+WsInflater::WsInflater(int windowBits, bool takeover) : takeover(takeover)
+{
+    std::memset(&stream, 0, sizeof(stream));
+    stream.zalloc = countedAlloc;
+    stream.zfree  = countedFree;
+    stream.opaque = &allocated;
+    if (inflateInit2(&stream, -windowBits) != Z_OK)
+        throw std::runtime_error("Couldn't initialize inflate stream");
+}
+
+WsInflater* WsInflater::shared()
+{
+    static thread_local WsInflater inflater(15, false);
+    return &inflater;
+}
+
+bool WsInflater::inflate(const std::string_view& message, std::string& out, size_t limit)
+{
+    // one byte of room past limit tells a message that is too large from one that fits exactly
+    size_t start = out.size(), produced = 0;
+    out.resize(start + std::min(limit + 1, std::max<size_t>(message.size() * 4, 1024)));
+    for (std::string_view in : {message, std::string_view(Tail, 4)}) {
+        stream.next_in  = (Bytef*)in.data();
+        stream.avail_in = (uInt)in.size();
+        while (stream.avail_in && produced <= limit) {
+            if (produced == out.size() - start)
+                out.resize(start + std::min(limit + 1, produced * 2));
+            stream.next_out  = (Bytef*)out.data() + start + produced;
+            stream.avail_out = (uInt)(out.size() - start - produced);
+            int ret          = ::inflate(&stream, Z_SYNC_FLUSH);
+            produced         = out.size() - start - stream.avail_out;
+            // a final block ends the stream, whatever follows starts a new one
+            if (ret == Z_STREAM_END)
+                inflateReset(&stream);
+            else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                out.resize(start);
+                inflateReset(&stream);
+                throw std::runtime_error("Corrupt compressed message");
+            }
+        }
+    }
+    if (produced > limit) {
+        out.resize(start);
+        inflateReset(&stream);
+        return false;
+    }
+    out.resize(start + produced);
+    if (!takeover) inflateReset(&stream);
+    return true;
+}
+
+bool WsInflater::inflate(const std::string_view&                             part,
+                         bool                                                last,
+                         std::string&                                        out,
+                         size_t                                              piece,
+                         const std::function<bool(const std::string_view&)>& emit)
+{
+    size_t produced = 0;
+    out.resize(piece);
+    for (std::string_view in : {part, std::string_view(Tail, last ? 4 : 0)}) {
+        stream.next_in  = (Bytef*)in.data();
+        stream.avail_in = (uInt)in.size();
+        // a full piece may have left output behind even with the input used up
+        bool full = false;
+        while (stream.avail_in || full) {
+            stream.next_out  = (Bytef*)out.data() + produced;
+            stream.avail_out = (uInt)(piece - produced);
+            int ret          = ::inflate(&stream, Z_SYNC_FLUSH);
+            produced         = piece - stream.avail_out;
+            full             = produced == piece;
+            if (ret == Z_STREAM_END)
+                inflateReset(&stream);
+            else if (ret == Z_BUF_ERROR && !full)
+                break;
+            else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                out.clear();
+                inflateReset(&stream);
+                throw std::runtime_error("Corrupt compressed message");
+            }
+            if (full) {
+                if (!emit(std::string_view(out.data(), produced))) {
+                    out.clear();
+                    inflateReset(&stream);
+                    return false;
+                }
+                produced = 0;
+            }
+        }
+    }
+    out.resize(produced);
+    if (last && !takeover) inflateReset(&stream);
+    return true;
+}
+
+WsInflater::~WsInflater() { inflateEnd(&stream); }
+
+}; // namespace cW
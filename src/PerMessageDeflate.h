@@ -0,0 +1,81 @@
+#ifndef __CW_PER_MESSAGE_DEFLATE_H_
+#define __CW_PER_MESSAGE_DEFLATE_H_
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <zlib.h>
+#include "WebSocketOpts.h"
+
+namespace cW {
+
+// what the handshake agreed on, window bits of 15 are left out of the response
+struct DeflateParams {
+    bool serverNoContextTakeover = false;
+    bool clientNoContextTakeover = false;
+    int  serverMaxWindowBits     = 15;
+    int  clientMaxWindowBits     = 15;
+};
+
+// picks the first permessage-deflate offer of a sec-websocket-extensions header that opts can
+// take. false when there is none and messages go uncompressed
+bool negotiateDeflate(const std::string_view& extensions,
+                      const WebSocketOpts&    opts,
+                      DeflateParams&          params);
+// the sec-websocket-extensions value accepting params, written to out. returns its length, never
+// more than MaxDeflateResponse
+size_t formatDeflate(const DeflateParams& params, char* out);
+constexpr size_t MaxDeflateResponse = 128;
+
+// raw deflate stream for outgoing messages. what zlib allocates is counted, so the memory a
+// connection holds can be told
+class WsDeflater {
+    z_stream stream;
+    bool     takeover;
+    size_t   allocated = 0;
+
+  public:
+    WsDeflater(int level, int windowBits, bool takeover);
+    WsDeflater(const WsDeflater&) = delete;
+    WsDeflater& operator=(const WsDeflater&) = delete;
+
+    // this loop's compressor without context takeover, shared by every connection using it
+    static WsDeflater* shared(int level, int windowBits);
+
+    // appends the compressed message, without the 00 00 ff ff the receiver adds back
+    void compress(const std::string_view& message, std::string& out);
+    inline size_t memory() const { return allocated; }
+
+    ~WsDeflater();
+};
+
+class WsInflater {
+    z_stream stream;
+    bool     takeover;
+    size_t   allocated = 0;
+
+  public:
+    WsInflater(int windowBits, bool takeover);
+    WsInflater(const WsInflater&) = delete;
+    WsInflater& operator=(const WsInflater&) = delete;
+
+    // this loop's inflater for clients that reset after every message
+    static WsInflater* shared();
+
+    // appends the inflated message. false once it would grow past limit, throws on corrupt data
+    bool inflate(const std::string_view& message, std::string& out, size_t limit);
+    // inflates a message part by part, the tail goes in after the last one. out is handed to emit
+    // every time piece bytes fill it, false from emit stops. whatever is left stays in out
+    bool inflate(const std::string_view&                             part,
+                 bool                                                last,
+                 std::string&                                        out,
+                 size_t                                              piece,
+                 const std::function<bool(const std::string_view&)>& emit);
+    inline size_t memory() const { return allocated; }
+
+    ~WsInflater();
+};
+
+}; // namespace cW
+
+#endif
@@ -2,10 +2,13 @@
 
 #include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 #include <cstdio>
 #include "ClientSocket.h"
 #include "ListenSocket.h"
+#include "Rcu.h"
 #include "Server.h"
 
 namespace cW {
@@ -19,6 +22,23 @@ Poll::Poll(const Server* server, bool onePoll) : server(server), onePoll(onePoll
         perror("Failed to create epoll");
         std::terminate();
     }
+    // not counted in nSockets, it shouldn't keep the loop alive
+    wakeSocket = new Socket(Socket::WAKE, eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC), false);
+    epoll_ctl(fd, EPOLL_CTL_ADD, wakeSocket->fd, (epoll_event*)(wakeSocket->event));
+
+    int        timer  = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    itimerspec second = {.it_interval = {1, 0}, .it_value = {1, 0}};
+    timerSocket       = new Socket(Socket::TIMER, timer, false);
+    timerfd_settime(timerSocket->fd, 0, &second, nullptr);
+    epoll_ctl(fd, EPOLL_CTL_ADD, timerSocket->fd, (epoll_event*)(timerSocket->event));
+}
+
+Poll::~Poll()
+{
+    close(wakeSocket->fd);
+    delete wakeSocket;
+    close(timerSocket->fd);
+    delete timerSocket;
 }
 
 void Poll::add(Socket* socket)
@@ -41,11 +61,13 @@ void Poll::remove(Socket* socket)
 
 void Poll::loop()
 {
-    static int  n = 1;
     epoll_event events[1024];
     char        buffer[bufferSize];
     while (nSockets > 0) {
+        // quiescent while blocked, nothing read from the routing table is held across batches
+        Rcu::offline();
         int nEvents = epoll_wait(fd, events, 1024, -1);
+        Rcu::online();
         if (nEvents < 0)
             perror("Epoll wait error");
         else {
@@ -66,6 +88,7 @@ void Poll::loop()
                             if (events[i].events & EPOLLIN) {
                                 ClientSocket* acceptSocket;
                                 while (acceptSocket = ClientSocket::from(socket, server, onePoll)) {
+                                    acceptSocket->poll = this;
                                     add(acceptSocket);
                                 }
                             }
@@ -78,52 +101,173 @@ void Poll::loop()
                         delete socket;
                         break;
                     }
-                    case Socket::Type::ACCEPT: {
-                        ClientSocket* socket =
-                            static_cast<ClientSocket*>((Socket*)events[i].data.ptr);
-                        socket->loopPreCb();
-                        if (!socket->connected) goto disconnect;
-                        if (events[i].events & (EPOLLERR | EPOLLHUP)) {
-                            socket->connected = false;
-                            socket->onAborted();
-                            goto disconnect;
-                        }
-                        else {
-                            if (events[i].events & EPOLLIN) {
-                                int bytesReceived = recv(socket->fd, buffer, bufferSize, 0);
-                                if (bytesReceived < 0) {
-                                    if (errno != EAGAIN) {
-                                        perror("Receive error");
-                                        goto disconnect;
-                                    }
-                                }
-                                else if (bytesReceived == 0) {
-                                    goto disconnect;
-                                }
-                                else
-                                    socket->onData(std::string_view(buffer, bytesReceived));
-                            }
-                            if (events[i].events & EPOLLOUT) socket->onWritable();
-                        }
-                        socket->loopPostCb();
-                        if (socket->connected) {
-                            update(socket,
-                                   EPOLLIN * socket->wantRead | EPOLLOUT * socket->wantWrite);
-                            break;
-                        }
-                    disconnect:
-                        printf("Closing socket %d\n", n++);
-                        remove(socket);
-                        shutdown(socket->fd, SHUT_WR);
-                        close(socket->fd);
-                        delete socket;
+                    case Socket::Type::ACCEPT:
+                        serve(static_cast<ClientSocket*>((Socket*)events[i].data.ptr),
+                              events[i].events, buffer);
                         break;
-                    }
+                    case Socket::Type::WAKE: drain(buffer); break;
+                    case Socket::Type::TIMER: tick(buffer); break;
                 }
             }
+            for (ClientSocket* socket : retired)
+                delete socket;
+            retired.clear();
         }
     }
 }
+
+void Poll::serve(ClientSocket* socket, uint32_t events, char* buffer)
+{
+    static int n = 1;
+    // a shared poll's socket can be written to by a thread delivering publications, which may
+    // also arm it again while another thread is still about to serve it
+    std::unique_lock lock(socket->mtx, std::defer_lock);
+    if (onePoll) lock.lock();
+    // closed by a wake or timer earlier in the batch
+    if (socket->closed) return;
+    socket->loopPreCb();
+    if (!socket->connected) goto disconnect;
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        socket->connected = false;
+        socket->onAborted();
+        goto disconnect;
+    }
+    else {
+        if (events & EPOLLIN) {
+            int bytesReceived = recv(socket->fd, buffer, bufferSize, 0);
+            if (bytesReceived < 0) {
+                if (errno != EAGAIN) {
+                    perror("Receive error");
+                    goto disconnect;
+                }
+            }
+            else if (bytesReceived == 0) {
+                goto disconnect;
+            }
+            else
+                socket->onData(std::string_view(buffer, bytesReceived));
+        }
+        if (events & EPOLLOUT) socket->onWritable();
+    }
+    socket->loopPostCb();
+    if (socket->connected) {
+        if (socket->park == ClientSocket::PARKING) {
+            auto parking = ClientSocket::PARKING;
+            if (socket->park.compare_exchange_strong(parking, ClientSocket::PARKED)) {
+                // whoever it waits on wakes it. a shared poll leaves it disarmed so no other
+                // thread can pick it up in the meantime
+                if (!onePoll) update(socket, EPOLLIN * socket->wantRead);
+                return;
+            }
+            // woken before it even got parked
+            socket->park      = ClientSocket::AWAKE;
+            socket->wantWrite = true;
+        }
+        update(socket, EPOLLIN * socket->wantRead | EPOLLOUT * socket->wantWrite);
+        return;
+    }
+disconnect:
+    printf("Closing socket %d\n", n++);
+    remove(socket);
+    shutdown(socket->fd, SHUT_WR);
+    if (socket->waited) {
+        // a wake may have been queued before the session left its flight
+        socket->endSession();
+        forget(socket);
+    }
+    close(socket->fd);
+    socket->closed = true;
+    if (!onePoll) {
+        retired.push_back(socket);
+        return;
+    }
+    // other threads may hold it from an event or a topic lookup until their batch ends. epoll can
+    // hand it out before its thread comes back online, so that takes two grace periods. the
+    // session goes now, it leaves its topics with it
+    socket->endSession();
+    lock.unlock();
+    Rcu::defer(socket, [socket, since = Rcu::advance(), passes = 0]() mutable {
+        if (!Rcu::released(since, since)) return false;
+        if (passes++ == 0) {
+            since = Rcu::advance();
+            return false;
+        }
+        delete socket;
+        return true;
+    });
+}
+
+void Poll::wake(ClientSocket* socket)
+{
+    while (true) {
+        auto state = socket->park.load();
+        if (state == ClientSocket::PARKING) {
+            // its loop is still busy with it and will see the flag
+            if (socket->park.compare_exchange_weak(state, ClientSocket::WOKEN)) return;
+        }
+        else if (state == ClientSocket::PARKED) {
+            if (socket->park.compare_exchange_weak(state, ClientSocket::AWAKE)) break;
+        }
+        else
+            return;
+    }
+    notify(socket);
+}
+
+void Poll::notify(ClientSocket* socket)
+{
+    {
+        std::lock_guard lock(wakeMutex);
+        woken.push_back(socket);
+    }
+    uint64_t one = 1;
+    ::write(wakeSocket->fd, &one, sizeof(one));
+}
+
+void Poll::drain(char* buffer)
+{
+    static thread_local std::vector<ClientSocket*> ready;
+    uint64_t                                       count;
+    ::read(wakeSocket->fd, &count, sizeof(count));
+    {
+        std::lock_guard lock(wakeMutex);
+        ready.swap(woken);
+    }
+    // nothing else can touch a parked socket, it gets served like any writable event. one that
+    // was only notified is served by this thread too, or under its lock on a shared poll
+    for (ClientSocket* socket : ready)
+        serve(socket, EPOLLOUT, buffer);
+    ready.clear();
+    pubsub.deliver(this, onePoll);
+}
+
+void Poll::tick(char* buffer)
+{
+    static thread_local std::vector<ClientSocket*> due;
+    uint64_t                                       expirations;
+    // every thread of a shared poll may be woken for it, the one that reads it takes it
+    if (::read(timerSocket->fd, &expirations, sizeof(expirations)) != sizeof(expirations)) return;
+    while (expirations--)
+        timers.advance(due);
+    // without events, the session finds its timer due once the socket is locked
+    for (ClientSocket* socket : due)
+        serve(socket, 0, buffer);
+    due.clear();
+}
+
+void Poll::publish(const std::string_view& topic, FrameBuffer* frame)
+{
+    if (!pubsub.post(topic, frame)) return;
+    uint64_t one = 1;
+    ::write(wakeSocket->fd, &one, sizeof(one));
+}
+
+void Poll::forget(ClientSocket* socket)
+{
+    std::lock_guard lock(wakeMutex);
+    std::erase(woken, socket);
+}
+
 void Poll::runLoop(int nThreads)
 {
     if (nThreads < 0) nThreads = std::thread::hardware_concurrency();
@@ -3,15 +3,20 @@
 
 #include <atomic>
 #include <cstdlib>
+#include <mutex>
 #include <thread>
 #include <vector>
+#include "PubSub.h"
 #include "Socket.h"
+#include "TimerWheel.h"
 
 namespace cW {
 
 class Server;
+class ClientSocket;
 
 class Poll {
+    friend class WebSocketSession;
 
     int                 fd;
     std::atomic<size_t> nSockets = 0;
@@ -21,16 +26,47 @@ class Poll {
 
     // static std::mutex mtx;
 
+    // parked or notified sockets handed back from other threads, announced through an eventfd
+    Socket*                    wakeSocket;
+    std::mutex                 wakeMutex;
+    std::vector<ClientSocket*> woken;
+
+    // topics of the websockets on this loop, publications arrive through the same eventfd
+    PubSub pubsub;
+
+    // websocket heartbeats, advanced by a timerfd every second
+    Socket*    timerSocket;
+    TimerWheel timers;
+
     void loop();
+    void serve(ClientSocket* socket, uint32_t events, char* buffer);
+    void drain(char* buffer);
+    // serves the sockets whose timers expired
+    void tick(char* buffer);
+    // drops a socket about to be deleted from the wake queue
+    void forget(ClientSocket* socket);
+    // closed while a batch of events is handled, deleted once it is done since a later event of
+    // the batch can still name them. a loop of its own only, a shared poll defers through rcu
+    std::vector<ClientSocket*> retired;
 
     const Server* server;
 
   public:
     Poll(const Server* server, bool onePoll = true);
+    ~Poll();
 
     void add(Socket* socket);
     void update(Socket* socket, uint32_t events) const;
     void remove(Socket* socket);
+    // from any thread: resumes a socket parked while waiting on another thread, its loop gets an
+    // onWritable round for it
+    void wake(ClientSocket* socket);
+    // from any thread: an onWritable round on its loop for a socket that isn't parked, like an
+    // http/2 connection with a stream waiting on another thread
+    void notify(ClientSocket* socket);
+    // from any thread: sends frame to the topic's subscribers on this loop, referencing it until
+    // they wrote it
+    void publish(const std::string_view& topic, FrameBuffer* frame);
 
     void runLoop(int nThreads = 1);
 };
@@ -0,0 +1,189 @@
+#include "PubSub.h"
+
+#include <sys/epoll.h>
+#include "ClientSocket.h"
+#include "Poll.h"
+#include "WebSocketSession.h"
+
+namespace cW {
+
+bool PubSub::subscribe(WebSocketSession* session, const std::string_view& name)
+{
+    std::lock_guard lock(topicsMutex);
+    auto            it = topics.find(name);
+    if (it == topics.end()) {
+        auto topic  = std::make_unique<Topic>();
+        topic->name = name;
+        // keyed by the topic's own copy of its name
+        it = topics.emplace(topic->name, std::move(topic)).first;
+    }
+    Topic* topic = it->second.get();
+    for (const Subscription& subscription : session->subscriptions)
+        if (subscription.topic == topic) return false;
+    topic->subscribers.emplace_back(session, session->subscriptions.size());
+    session->subscriptions.push_back({topic, topic->subscribers.size() - 1});
+    return true;
+}
+
+bool PubSub::unsubscribe(WebSocketSession* session, const std::string_view& name)
+{
+    std::lock_guard lock(topicsMutex);
+    for (size_t i = 0; i < session->subscriptions.size(); i++)
+        if (session->subscriptions[i].topic->name == name) {
+            leave(session, i);
+            return true;
+        }
+    return false;
+}
+
+void PubSub::unsubscribeAll(WebSocketSession* session)
+{
+    std::lock_guard lock(topicsMutex);
+    while (!session->subscriptions.empty())
+        leave(session, session->subscriptions.size() - 1);
+}
+
+// both sides fill the hole with their last entry and tell it where it moved
+void PubSub::leave(WebSocketSession* session, size_t index)
+{
+    auto [topic, slot] = session->subscriptions[index];
+    auto moved         = topic->subscribers.back();
+
+    topic->subscribers[slot]                       = moved;
+    moved.first->subscriptions[moved.second].index = slot;
+    topic->subscribers.pop_back();
+
+    if (index + 1 < session->subscriptions.size()) {
+        Subscription last                          = session->subscriptions.back();
+        session->subscriptions[index]              = last;
+        last.topic->subscribers[last.index].second = index;
+    }
+    session->subscriptions.pop_back();
+
+    // erased by iterator, the key views the name going with it
+    if (topic->subscribers.empty()) topics.erase(topics.find(topic->name));
+}
+
+bool PubSub::post(const std::string_view& topic, FrameBuffer* frame)
+{
+    std::lock_guard lock(inboxMutex);
+    inbox.emplace_back(topic, frame->retain());
+    return inbox.size() == 1;
+}
+
+void PubSub::deliver(Poll* poll, bool onePoll)
+{
+    static thread_local std::vector<std::pair<std::string, FrameBuffer*>> posted;
+    static thread_local std::vector<ClientSocket*>                        touched;
+    while (true) {
+        {
+            // threads of a shared poll take turns, so subscribers get messages in the order they
+            // were posted. one finding it taken leaves what it was woken for to the other
+            std::unique_lock delivering(deliverMutex, std::try_to_lock);
+            if (!delivering) return;
+            while (true) {
+                {
+                    std::lock_guard lock(inboxMutex);
+                    posted.swap(inbox);
+                }
+                if (posted.empty()) break;
+                for (auto& [topic, frame] : posted) {
+                    send(onePoll, topic, frame, touched);
+                    frame->release();
+                }
+                posted.clear();
+                // a burst goes out in one write per socket
+                for (ClientSocket* socket : touched)
+                    flush(poll, onePoll, socket);
+                touched.clear();
+            }
+        }
+        // whatever was posted while the last turn was ending must not be left behind
+        std::lock_guard lock(inboxMutex);
+        if (inbox.empty()) return;
+    }
+}
+
+void PubSub::send(bool                        onePoll,
+                  const std::string_view&     topic,
+                  FrameBuffer*                frame,
+                  std::vector<ClientSocket*>& touched)
+{
+    static thread_local std::vector<ClientSocket*> receivers;
+    static thread_local std::string                compressed;
+    {
+        std::lock_guard lock(topicsMutex);
+        auto            it = topics.find(topic);
+        if (it == topics.end()) return;
+        for (auto& [session, index] : it->second->subscribers)
+            receivers.push_back(session->socket);
+    }
+    // one reference for every receiver up front, the last one to write it frees it
+    frame->refs.fetch_add((uint32_t)receivers.size(), std::memory_order_relaxed);
+    size_t       unused   = 0;
+    FrameBuffer* deflated = nullptr;
+    int          deflatedLevel, deflatedBits;
+    for (ClientSocket* socket : receivers) {
+        // a shared poll's socket may be served by another thread meanwhile, or closed since it
+        // was looked up. its memory stays at least until this batch ends
+        std::unique_lock lock(socket->mtx, std::defer_lock);
+        if (onePoll) lock.lock();
+        auto* session = static_cast<WebSocketSession*>(socket->currentSession);
+        if (socket->closed || !session || !session->admit(true)) {
+            unused++;
+            continue;
+        }
+        FrameBuffer* queued = frame;
+        // connections on the loop's shared compressor all take the same compressed frame, made
+        // for the first of them
+        if (session->compression && session->deflateParams.serverNoContextTakeover &&
+            frame->payload().size() >= session->opts()->MinCompressLength) {
+            int level = session->opts()->CompressionLevel;
+            int bits  = session->deflateParams.serverMaxWindowBits;
+            if (!deflated) {
+                compressed.clear();
+                WsDeflater::shared(level, bits)->compress(frame->payload(), compressed);
+                deflated      = FrameBuffer::format(frame->opcode, compressed.data(),
+                                                    compressed.size(), true, true);
+                deflatedLevel = level;
+                deflatedBits  = bits;
+            }
+            if (level == deflatedLevel && bits == deflatedBits) {
+                queued = deflated->retain();
+                unused++;
+            }
+        }
+        session->queueFrame(queued);
+        if (!session->flushPending) {
+            session->flushPending = true;
+            touched.push_back(socket);
+        }
+    }
+    // the caller still holds the reference posting took, this never reaches zero
+    frame->refs.fetch_sub((uint32_t)unused, std::memory_order_relaxed);
+    if (deflated) deflated->release();
+    receivers.clear();
+}
+
+void PubSub::flush(Poll* poll, bool onePoll, ClientSocket* socket)
+{
+    std::unique_lock lock(socket->mtx, std::defer_lock);
+    if (onePoll) lock.lock();
+    auto* session = static_cast<WebSocketSession*>(socket->currentSession);
+    if (socket->closed || !session) return;
+    session->flushPending = false;
+    session->writeFrames();
+    // whatever the socket didn't take goes out on its next writable event, which also brings
+    // the drain a congested one is waiting for
+    if ((socket->wantWrite || !socket->connected || session->congested) &&
+        socket->park == ClientSocket::AWAKE)
+        poll->update(socket, EPOLLIN * socket->wantRead | EPOLLOUT);
+}
+
+PubSub::~PubSub()
+{
+    for (auto& [name, frame] : inbox)
+        frame->release();
+}
+
+}; // namespace cW
@@ -0,0 +1,74 @@
+#ifndef __CW_PUB_SUB_H_
+#define __CW_PUB_SUB_H_
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "FrameBuffer.h"
+
+namespace cW {
+
+class Poll;
+class ClientSocket;
+class WebSocketSession;
+
+// the topics websockets on one loop are subscribed to, and the inbox other threads publish to.
+// every loop has its own, a publish visits each inbox once and never takes a lock shared by all
+// of them
+class PubSub {
+  public:
+    struct Topic;
+    // one session in one topic. each side keeps the other's index so leaving is constant time
+    struct Subscription {
+        Topic* topic;
+        size_t index;
+    };
+    struct Topic {
+        std::string                                       name;
+        std::vector<std::pair<WebSocketSession*, size_t>> subscribers;
+    };
+
+  private:
+    // only contended by the threads of a shared poll, a loop of its own takes it uncontended
+    std::mutex                                                   topicsMutex;
+    std::unordered_map<std::string_view, std::unique_ptr<Topic>> topics;
+
+    std::mutex                                        inboxMutex;
+    std::vector<std::pair<std::string, FrameBuffer*>> inbox;
+    std::mutex                                        deliverMutex;
+
+    void leave(WebSocketSession* session, size_t index);
+    // queues frame on the topic's subscribers, adding the sockets not touched yet
+    void send(bool                        onePoll,
+              const std::string_view&     topic,
+              FrameBuffer*                frame,
+              std::vector<ClientSocket*>& touched);
+    // writes what the socket takes of its queue, arming it for the rest
+    void flush(Poll* poll, bool onePoll, ClientSocket* socket);
+
+  public:
+    PubSub()              = default;
+    PubSub(const PubSub&) = delete;
+    PubSub& operator=(const PubSub&) = delete;
+
+    // loop thread, false if it already was / wasn't subscribed
+    bool subscribe(WebSocketSession* session, const std::string_view& topic);
+    bool unsubscribe(WebSocketSession* session, const std::string_view& topic);
+    void unsubscribeAll(WebSocketSession* session);
+
+    // any thread, takes a reference to frame. true when the inbox was empty and the loop has to
+    // be woken for it
+    bool post(const std::string_view& topic, FrameBuffer* frame);
+    // loop thread, sends everything posted since the last time
+    void deliver(Poll* poll, bool onePoll);
+
+    ~PubSub();
+};
+
+}; // namespace cW
+
+#endif
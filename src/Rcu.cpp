@@ -0,0 +1,109 @@
+#include "Rcu.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace cW {
+
+const uint64_t Rcu::Window = 64;
+
+namespace {
+constexpr uint64_t Offline = UINT64_MAX;
+
+struct Reader;
+
+std::atomic<uint64_t> epoch = 1;
+std::mutex            readersMutex;
+std::vector<Reader*>  readers;
+// pins left by threads that exited, released later by others
+std::vector<int64_t> orphans(Rcu::Window);
+
+std::mutex                                                 reclaimMutex;
+std::vector<std::pair<const void*, std::function<bool()>>> reclaimers;
+std::atomic<bool>                                          reclaiming = false;
+
+struct Reader {
+    // epoch seen at the last quiescent point, Offline while blocked or not a loop at all
+    std::atomic<uint64_t> seen = Offline;
+    // only written by the owning thread, summed by writers. a count can go negative on one
+    // thread when the request ended on another
+    std::vector<std::atomic<int64_t>> pins;
+
+    Reader() : pins(Rcu::Window)
+    {
+        std::lock_guard lock(readersMutex);
+        readers.push_back(this);
+    }
+    ~Reader()
+    {
+        std::lock_guard lock(readersMutex);
+        std::erase(readers, this);
+        for (size_t i = 0; i < Rcu::Window; i++)
+            orphans[i] += pins[i].load(std::memory_order_relaxed);
+    }
+};
+
+thread_local Reader reader;
+
+inline void add(std::atomic<int64_t>& counter, int64_t value)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+void reclaim()
+{
+    std::unique_lock lock(reclaimMutex, std::try_to_lock);
+    if (!lock) return;
+    std::erase_if(reclaimers, [](auto& reclaimer) { return reclaimer.second(); });
+    reclaiming.store(!reclaimers.empty(), std::memory_order_relaxed);
+}
+} // namespace
+
+uint64_t Rcu::advance() { return epoch.fetch_add(1) + 1; }
+
+void Rcu::offline() { reader.seen.store(Offline); }
+
+void Rcu::online()
+{
+    reader.seen.store(epoch.load());
+    if (reclaiming.load(std::memory_order_relaxed)) reclaim();
+}
+
+void Rcu::pin(uint64_t epoch) { add(reader.pins[epoch % Window], 1); }
+
+void Rcu::unpin(uint64_t epoch) { add(reader.pins[epoch % Window], -1); }
+
+bool Rcu::released(uint64_t epoch, uint64_t since)
+{
+    std::lock_guard lock(readersMutex);
+    for (Reader* other : readers) {
+        uint64_t seen = other->seen.load();
+        if (seen != Offline && seen < since) return false;
+    }
+    // pins taken before those quiescent points are visible now, releases may still lag which only
+    // keeps the sum high
+    int64_t pinned = orphans[epoch % Window];
+    for (Reader* other : readers)
+        pinned += other->pins[epoch % Window].load(std::memory_order_relaxed);
+    return pinned == 0;
+}
+
+void Rcu::defer(const void* owner, std::function<bool()>&& reclaim)
+{
+    std::lock_guard lock(reclaimMutex);
+    if (std::none_of(reclaimers.begin(), reclaimers.end(),
+                     [owner](auto& reclaimer) { return reclaimer.first == owner; }))
+        reclaimers.emplace_back(owner, std::move(reclaim));
+    reclaiming.store(true, std::memory_order_relaxed);
+}
+
+void Rcu::cancel(const void* owner)
+{
+    std::lock_guard lock(reclaimMutex);
+    std::erase_if(reclaimers, [owner](auto& reclaimer) { return reclaimer.first == owner; });
+    reclaiming.store(!reclaimers.empty(), std::memory_order_relaxed);
+}
+
+}; // namespace cW
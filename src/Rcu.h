@@ -0,0 +1,41 @@
+#ifndef __CW_RCU_H_
+#define __CW_RCU_H_
+
+#include <cstdint>
+#include <functional>
+
+namespace cW {
+
+// quiescent state based reclamation for data the event loops read without locking. a loop is
+// quiescent between batches of events and offline while it blocks, so whatever a writer replaced
+// is unreachable once every loop has been quiescent since. requests that outlive their batch pin
+// the epoch of what they read until they end
+class Rcu {
+  public:
+    // pins are counted in this many slots per thread, epochs sharing a slot only delay each other
+    static const uint64_t Window;
+
+    // a fresh epoch, published data is tagged with one and retired after the next
+    static uint64_t advance();
+
+    // event loop threads, around blocking waits. coming back online is a quiescent point
+    static void offline();
+    static void online();
+
+    // any thread, a pinned epoch can be released by a different thread than the one pinning it
+    static void pin(uint64_t epoch);
+    static void unpin(uint64_t epoch);
+
+    // writer: true once every loop has been quiescent since the epoch `since` was reached and
+    // nothing read at `epoch` is still pinned
+    static bool released(uint64_t epoch, uint64_t since);
+
+    // reclaim runs at quiescent points while there is something left for it, it returns true
+    // when it is done. one per owner
+    static void defer(const void* owner, std::function<bool()>&& reclaim);
+    static void cancel(const void* owner);
+};
+
+}; // namespace cW
+
+#endif
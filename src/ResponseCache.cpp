@@ -0,0 +1,189 @@
+#include "ResponseCache.h"
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "Router.h"
+
+namespace cW {
+
+const size_t ResponseCache::ShardCapacity = 32 * 1024 * 1024;
+
+namespace {
+struct Shard;
+
+std::mutex           registryMutex;
+std::vector<Shard*>  registry;
+ResponseCache::Stats retired;
+
+struct Shard {
+    // most recently used first, the index views the key inside each entry
+    std::list<ResponseCache::Entry>                                               order;
+    std::unordered_map<std::string_view, std::list<ResponseCache::Entry>::iterator> index;
+    size_t                                                                        bytes = 0;
+
+    // only written by the owning thread, read by stats()
+    std::atomic<size_t> hits = 0, misses = 0, stores = 0, evictions = 0, expirations = 0;
+    std::atomic<size_t> entries = 0, size = 0;
+
+    Shard()
+    {
+        std::lock_guard lock(registryMutex);
+        registry.push_back(this);
+    }
+    ~Shard()
+    {
+        std::lock_guard lock(registryMutex);
+        std::erase(registry, this);
+        retired.hits += hits;
+        retired.misses += misses;
+        retired.stores += stores;
+        retired.evictions += evictions;
+        retired.expirations += expirations;
+    }
+
+    void erase(std::list<ResponseCache::Entry>::iterator itr)
+    {
+        bytes -= (*itr)->data.size();
+        index.erase((*itr)->key);
+        order.erase(itr);
+        entries.store(index.size(), std::memory_order_relaxed);
+        size.store(bytes, std::memory_order_relaxed);
+    }
+};
+
+thread_local Shard shard;
+
+inline void count(std::atomic<size_t>& counter)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// raw value of a query parameter, still url encoded which is fine for a key
+std::string_view findQuery(const std::string_view& querySection, const std::string_view& name)
+{
+    size_t len = querySection.size();
+    for (size_t i = 0; i < len;) {
+        size_t           next = std::min(querySection.find('&', i), len);
+        std::string_view item = querySection.substr(i, next - i);
+        i                     = next + 1;
+        if (item.size() > name.size() && item.starts_with(name) && item[name.size()] == '=')
+            return item.substr(name.size() + 1);
+    }
+    return std::string_view();
+}
+} // namespace
+
+bool ResponseCache::key(HttpRequest* request, HttpResponse* response)
+{
+    static const char* conditional[] = {"range",    "if-none-match",       "if-modified-since",
+                                        "if-match", "if-unmodified-since", "if-range"};
+    const HttpOpts*    opts          = request->opts;
+    uint64_t           route         = response->route->id;
+    std::string_view   value;
+    // validators and ranges are answered by the handler, the cache only holds full 200s
+    for (const char* name : conditional)
+        if (request->findHeader(name, value)) return false;
+
+    // the route, the negotiated encodings, the path and the selected variants
+    std::pmr::string key(&request->memory);
+    key.append((const char*)&route, sizeof(route));
+    key += (char)response->encoding;
+    key += (char)response->staticEncoding;
+    key += request->absolutePath;
+    for (const std::string& name : opts->CacheKeyQueries) {
+        key += '\0';
+        key += findQuery(request->querySection, name);
+    }
+    for (const std::string& name : opts->CacheKeyHeaders) {
+        key += '\0';
+        if (request->findHeader(name, value)) key += value;
+    }
+    // short keys live inside the string object itself
+    response->cacheKey = request->memory.copy(key);
+    response->cacheTTL = opts->CacheTTL;
+    return true;
+}
+
+bool ResponseCache::lookup(HttpResponse* response)
+{
+    auto itr = shard.index.find(response->cacheKey);
+    if (itr == shard.index.end()) {
+        count(shard.misses);
+        return false;
+    }
+    if ((*itr->second)->expires <= std::chrono::steady_clock::now()) {
+        shard.erase(itr->second);
+        count(shard.expirations);
+        count(shard.misses);
+        return false;
+    }
+    shard.order.splice(shard.order.begin(), shard.order, itr->second);
+    response->cached = *itr->second;
+    count(shard.hits);
+    return true;
+}
+
+ResponseCache::Entry ResponseCache::store(HttpResponse* response)
+{
+    auto entry    = std::make_shared<CachedResponse>();
+    entry->key    = response->cacheKey;
+    entry->status = response->statusCode;
+    entry->expires =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(response->cacheTTL);
+
+    std::string& data = entry->data;
+    data.reserve(256 + response->buffer.size());
+    data += "HTTP/1.1 ";
+    data += HttpStatus::status(response->statusCode);
+    data += "\r\n";
+    for (auto& [name, value] : response->headers) {
+        data += name;
+        data += ": ";
+        data += value;
+        data += "\r\n";
+    }
+    data += "\r\n";
+    entry->headerLength = data.size();
+    data += response->buffer;
+
+    // coalesced but not cached, or too large to be worth a slot
+    if (!response->cacheTTL || data.size() > response->request->opts->MaxCachedLength ||
+        data.size() > ShardCapacity / 8)
+        return entry;
+    if (auto itr = shard.index.find(entry->key); itr != shard.index.end())
+        shard.erase(itr->second);
+    while (shard.bytes + data.size() > ShardCapacity && !shard.order.empty()) {
+        shard.erase(std::prev(shard.order.end()));
+        count(shard.evictions);
+    }
+    shard.order.push_front(entry);
+    shard.index.emplace(entry->key, shard.order.begin());
+    shard.bytes += data.size();
+    shard.entries.store(shard.index.size(), std::memory_order_relaxed);
+    shard.size.store(shard.bytes, std::memory_order_relaxed);
+    count(shard.stores);
+    return entry;
+}
+
+ResponseCache::Stats ResponseCache::stats()
+{
+    std::lock_guard lock(registryMutex);
+    Stats           total = retired;
+    for (Shard* shard : registry) {
+        total.hits += shard->hits.load(std::memory_order_relaxed);
+        total.misses += shard->misses.load(std::memory_order_relaxed);
+        total.stores += shard->stores.load(std::memory_order_relaxed);
+        total.evictions += shard->evictions.load(std::memory_order_relaxed);
+        total.expirations += shard->expirations.load(std::memory_order_relaxed);
+        total.entries += shard->entries.load(std::memory_order_relaxed);
+        total.bytes += shard->size.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+}; // namespace cW
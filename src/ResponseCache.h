@@ -0,0 +1,56 @@
+#ifndef __CW_RESPONSE_CACHE_H_
+#define __CW_RESPONSE_CACHE_H_
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include "HttpStatusCodes_C++.h"
+
+namespace cW {
+
+class HttpRequest;
+class HttpResponse;
+
+struct CachedResponse {
+    std::string key;
+    // status line, headers and body exactly as sent over http/1.1
+    std::string      data;
+    size_t           headerLength;
+    HttpStatus::Code status;
+
+    std::chrono::steady_clock::time_point expires;
+};
+
+// micro-cache for GET routes with HttpOpts::CacheTTL set. every event loop thread keeps its own
+// LRU shard, so lookups and stores never take a lock
+class ResponseCache {
+  public:
+    typedef std::shared_ptr<const CachedResponse> Entry;
+
+    struct Stats {
+        size_t hits        = 0;
+        size_t misses      = 0;
+        size_t stores      = 0;
+        size_t evictions   = 0;
+        size_t expirations = 0;
+        size_t entries     = 0;
+        size_t bytes       = 0;
+    };
+
+    // per thread
+    static const size_t ShardCapacity;
+
+    // builds the key the response is cached and coalesced under. false for requests only the
+    // handler can answer, like ranges and conditional GETs
+    static bool key(HttpRequest* request, HttpResponse* response);
+    // on a hit the response replays the entry and the handler can be skipped
+    static bool lookup(HttpResponse* response);
+    // serializes a finished response, kept in the calling thread's shard if the route caches
+    static Entry store(HttpResponse* response);
+    // summed over every thread
+    static Stats stats();
+};
+
+}; // namespace cW
+
+#endif
@@ -1,28 +1,364 @@
+#include <algorithm>
 #include <iostream>
+#include "Rcu.h"
 #include "Router.h"
 
 namespace cW {
 
-void Router::addHttpHandler(const char* route, HttpMethod method, HttpHandler&& handler)
+namespace {
+inline bool boundary(const std::string_view& run, size_t pos)
 {
-    httpRoutes.push_back(
-        new HttpRoute{.method = method, .handler = handler, .path = UrlPath(route)});
+    return pos == run.size() || run[pos] == '/';
 }
-void Router::addWsHandler(const char* route, WsEvent event, WsHandler&& handler)
+
+// siblings are ordered by their first segment
+constexpr auto headLess = [](const auto* child, const std::string_view& segment) {
+    return child->head() < segment;
+};
+
+// an id too large for int64_t doesn't name anything, the route doesn't match
+inline bool isInt(const std::string_view& segment)
 {
-    wsRoutes.push_back(new WsRoute{.event = event, .handler = handler, .path = UrlPath(route)});
+    if (segment.empty()) return false;
+    for (char c : segment)
+        if (!isdigit(c)) return false;
+    int64_t value;
+    return std::from_chars(segment.data(), segment.data() + segment.size(), value).ec ==
+           std::errc();
 }
 
-bool Router::dispatch(HttpRequest* request, HttpResponse* response) const
+inline bool isFloat(const std::string_view& segment)
 {
-    // printf("Routing...\n");
-    for (size_t i = 0; i < httpRoutes.size(); i++) {
-        if (httpRoutes[i]->method == request->method &&
-            httpRoutes[i]->path == request->absolutePath) {
-            request->urlPath = &(httpRoutes[i]->path);
-            httpRoutes[i]->handler(request, response);
-            return true;
+    if (segment.empty()) return false;
+    for (char c : segment)
+        if (!isdigit(c) && c != '.') return false;
+    return true;
+}
+// route ids, across every router
+std::atomic<uint64_t> routeIds = 0;
+} // namespace
+
+Router::Node::Node(const std::string_view& prefix)
+    : prefix(prefix), headLength(std::min(prefix.find('/'), prefix.size()))
+{
+}
+
+Router::Node::Node(const Node& other)
+    : prefix(other.prefix), headLength(other.headLength), statics(other.statics.size())
+{
+    for (size_t i = 0; i < statics.size(); i++)
+        statics[i] = new Node(*other.statics[i]);
+    for (size_t i = 0; i < 3; i++)
+        params[i] = other.params[i] ? new Node(*other.params[i]) : nullptr;
+    wildcard = other.wildcard ? new Node(*other.wildcard) : nullptr;
+    std::copy(std::begin(other.routes), std::end(other.routes), std::begin(routes));
+}
+
+Router::Node* Router::Node::findStatic(const std::string_view& segment) const
+{
+    auto itr = std::lower_bound(statics.begin(), statics.end(), segment, headLess);
+    return itr != statics.end() && (*itr)->head() == segment ? *itr : nullptr;
+}
+
+Router::Node::~Node()
+{
+    for (Node* child : statics)
+        delete child;
+    for (Node* child : params)
+        delete child;
+    delete wildcard;
+}
+
+Router::Table::Table() : epoch(Rcu::advance()) {}
+
+Router::Table::Table(const Table& other) : epoch(other.epoch), root(other.root), routes(other.routes)
+{
+    for (auto& [name, node] : other.hosts)
+        hosts.emplace(name, new Node(*node));
+    for (auto& [name, node] : other.wildcardHosts)
+        wildcardHosts.emplace(name, new Node(*node));
+}
+
+Router::Table::~Table()
+{
+    for (auto& [name, node] : hosts)
+        delete node;
+    for (auto& [name, node] : wildcardHosts)
+        delete node;
+}
+
+Router::Router() : table(new Table()) {}
+
+Router::Node* Router::insertStatic(Node* node, std::string_view run)
+{
+    std::string_view head = run.substr(0, run.find('/'));
+
+    auto itr = std::lower_bound(node->statics.begin(), node->statics.end(), head, headLess);
+    if (itr == node->statics.end() || (*itr)->head() != head)
+        return *node->statics.insert(itr, new Node(run));
+
+    // longest common run of whole segments, at least the head
+    Node*  child = *itr;
+    size_t n     = std::min(run.size(), child->prefix.size()), common = 0;
+    while (common < n && run[common] == child->prefix[common])
+        common++;
+    while (!boundary(run, common) || !boundary(child->prefix, common))
+        common--;
+    if (common < child->prefix.size()) {
+        Node* split = new Node(run.substr(0, common));
+        child->prefix.erase(0, common + 1);
+        child->headLength = std::min(child->prefix.find('/'), child->prefix.size());
+        split->statics.push_back(child);
+        *itr  = split;
+        child = split;
+    }
+    return common == run.size() ? child : insertStatic(child, run.substr(common + 1));
+}
+
+Router::Node* Router::findRun(Node* node, std::string_view run)
+{
+    Node* child = node->findStatic(run.substr(0, run.find('/')));
+    if (!child || !run.starts_with(child->prefix) || !boundary(run, child->prefix.size()))
+        return nullptr;
+    return run.size() == child->prefix.size() ? child
+                                              : findRun(child, run.substr(child->prefix.size() + 1));
+}
+
+void Router::addHttpHandler(const char*     route,
+                            HttpMethod      method,
+                            HttpHandler&&   handler,
+                            const HttpOpts& opts,
+                            const char*     host)
+{
+    std::unique_ptr<HttpRoute> httpRoute(new HttpRoute{
+        .method  = method,
+        .pattern = route,
+        .path    = UrlPath("/"),
+        .opts    = opts,
+        .handler = new HttpHandler(std::move(handler)),
+        .call    = [](const HttpRoute* route, HttpRequest* request, HttpResponse* response) {
+            (*(HttpHandler*)route->handler)(request, response);
+        },
+        .destroy = [](void* handler) { delete (HttpHandler*)handler; }});
+    // the caller's string may not outlive the route. a pattern UrlPath refuses frees it again
+    httpRoute->path = UrlPath(httpRoute->pattern);
+    insert(httpRoute.release(), host);
+}
+
+Router::Node* Router::tree(Table* table, const char* host, bool create)
+{
+    if (!host) return &table->root;
+    std::string name  = to_lower(std::string(host));
+    HostTable*  hosts = &table->hosts;
+    if (name.starts_with("*.")) {
+        name.erase(0, 2);
+        hosts = &table->wildcardHosts;
+    }
+    assert(!name.empty() && "Empty host");
+    if (!create) {
+        auto itr = hosts->find(name);
+        return itr == hosts->end() ? nullptr : itr->second;
+    }
+    Node*& node = (*hosts)[name];
+    if (!node) node = new Node();
+    return node;
+}
+
+const Router::Node* Router::select(const Table* table, HttpRequest* request)
+{
+    const Node*      root = &table->root;
+    std::string_view host;
+    if (!request->findHeader("host", host) || host.empty()) return root;
+    // without the port, brackets stay on ipv6 literals
+    host = host.substr(0, host[0] == '[' ? host.find(']') + 1 : host.find(':'));
+    if (!host.empty() && host.back() == '.') host.remove_suffix(1);
+    char name[256];
+    if (host.size() > sizeof(name)) return root;
+    for (size_t i = 0; i < host.size(); i++)
+        name[i] = to_lower(host[i]);
+    std::string_view lower(name, host.size());
+
+    if (auto itr = table->hosts.find(lower); itr != table->hosts.end()) return itr->second;
+    // most specific wildcard first
+    for (size_t dot = lower.find('.'); dot != std::string_view::npos;) {
+        auto itr = table->wildcardHosts.find(lower.substr(dot + 1));
+        if (itr != table->wildcardHosts.end()) return itr->second;
+        dot = lower.find('.', dot + 1);
+    }
+    return root;
+}
+
+Router::Table* Router::editing()
+{
+    assert((draft || !live) && "Http routes only change inside update() once the server runs");
+    return draft ? draft : table.load();
+}
+
+void Router::insert(HttpRoute* route, const char* host)
+{
+    Table* table = editing();
+    route->id    = ++routeIds;
+    table->routes.emplace_back(route);
+    Node* node = locate(tree(table, host, true), route->path, true);
+    // the first registration of a pattern wins, as with the old linear scan
+    if (!node->routes[route->method]) node->routes[route->method] = route;
+}
+
+bool Router::removeHttpHandler(const char* route, HttpMethod method, const char* host)
+{
+    Table*  table = editing();
+    UrlPath path(route);
+    Node*   node = tree(table, host, false);
+    if (node) node = locate(node, path, false);
+    if (!node || !node->routes[method]) return false;
+    HttpRoute* removed    = node->routes[method];
+    node->routes[method] = nullptr;
+    std::erase_if(table->routes, [removed](auto& route) { return route.get() == removed; });
+    return true;
+}
+
+// the node a pattern ends at, nullptr if it isn't in the tree and create is false
+Router::Node* Router::locate(Node* node, const UrlPath& path, bool create)
+{
+    const auto& levels = path.levels;
+    for (size_t i = 0; node && i < levels.size();) {
+        switch (levels[i].type) {
+            case UrlPath::UrlLevel::ABOSULUTE: {
+                // the whole run of static segments goes in at once
+                size_t last = i;
+                while (last + 1 < levels.size() &&
+                       levels[last + 1].type == UrlPath::UrlLevel::ABOSULUTE)
+                    last++;
+                const char*      begin = levels[i].val.data();
+                const char*      end   = levels[last].val.data() + levels[last].val.size();
+                std::string_view run(begin, end - begin);
+                node = create ? insertStatic(node, run) : findRun(node, run);
+                i    = last + 1;
+                continue;
+            }
+            case UrlPath::UrlLevel::WILDCARD:
+                if (!node->wildcard && create) node->wildcard = new Node();
+                node = node->wildcard;
+                break;
+            default: {
+                Node*& param = node->params[levels[i].type - UrlPath::UrlLevel::PARAM_INT];
+                if (!param && create) param = new Node();
+                node = param;
+                break;
+            }
         }
+        i++;
+    }
+    return node;
+}
+
+void Router::addWsHandler(const char*          route,
+                          WsEvent              event,
+                          WsHandler&&          handler,
+                          const WebSocketOpts& opts)
+{
+    assert(!live && "WebSocket routes can't change once the server runs");
+    wsRoutes.push_back(
+        new WsRoute{.event = event, .handler = handler, .path = UrlPath(route), .opts = opts});
+}
+
+void Router::insertMiddleware(const GlobalMiddleware& erased)
+{
+    assert(!live && "Middleware can't change once the server runs");
+    middleware.push_back(erased);
+}
+
+// static segments beat params, params beat wildcards. a dead end backs up and tries the next kind
+HttpRoute* Router::match(const Node* node, std::string_view rest, bool end, HttpMethod method)
+{
+    if (end) return node->routes[method];
+    size_t           slash   = rest.find('/');
+    bool             last    = slash == std::string_view::npos;
+    std::string_view segment = rest.substr(0, slash);
+    std::string_view next    = last ? std::string_view() : rest.substr(slash + 1);
+    HttpRoute*       route;
+
+    if (Node* child = node->findStatic(segment)) {
+        const std::string& prefix = child->prefix;
+        if (rest.starts_with(prefix) && boundary(rest, prefix.size())) {
+            bool consumed = rest.size() == prefix.size();
+            route = match(child, consumed ? std::string_view() : rest.substr(prefix.size() + 1),
+                          consumed, method);
+            if (route) return route;
+        }
+    }
+    if (node->params[0] && isInt(segment) && (route = match(node->params[0], next, last, method)))
+        return route;
+    if (node->params[1] && isFloat(segment) &&
+        (route = match(node->params[1], next, last, method)))
+        return route;
+    if (node->params[2] && (route = match(node->params[2], next, last, method))) return route;
+    if (node->wildcard) {
+        // a wildcard in the middle stands for one segment, at the end it takes the rest
+        if ((route = match(node->wildcard, next, last, method))) return route;
+        return node->wildcard->routes[method];
+    }
+    return nullptr;
+}
+
+HttpRoute* Router::lookup(const Node* tree, HttpMethod method, std::string_view absPath)
+{
+    if (absPath.empty() || absPath[0] != '/' || method > HttpMethod::HEAD) return nullptr;
+    // a trailing slash names the same resource
+    if (absPath.size() > 1 && absPath.back() == '/') absPath.remove_suffix(1);
+    absPath.remove_prefix(1);
+    return match(tree, absPath, absPath.empty(), method);
+}
+
+const UrlPath* Router::find(HttpMethod method, const std::string_view& absPath) const
+{
+    HttpRoute* route = lookup(&table.load()->root, method, absPath);
+    return route ? &route->path : nullptr;
+}
+
+bool Router::dispatch(HttpRequest* request, HttpResponse* response) const
+{
+    // loaded once, a table replaced meanwhile stays readable until this loop is quiescent
+    const Table* current = table.load();
+    // the host picks the tree once, a host with its own routes never falls back to the others
+    bool        anyHost = current->hosts.empty() && current->wildcardHosts.empty();
+    const Node* tree    = anyHost ? &current->root : select(current, request);
+    HttpRoute*  route   = lookup(tree, request->method, request->absolutePath);
+    if (!route) return false;
+    // the route has to outlive the table for as long as the request runs
+    Rcu::pin(current->epoch);
+    request->routeEpoch = current->epoch;
+    request->urlPath = &route->path;
+    request->opts    = &route->opts;
+    response->route  = route;
+    if (request->opts->Compress) {
+        std::string_view acceptEncoding;
+        request->findHeader("accept-encoding", acceptEncoding);
+        response->negotiate(acceptEncoding, request->opts);
+    }
+    // server-wide middleware wraps everything below, a before() that answered skips the rest
+    // and the afters of those that didn't run
+    size_t entered = 0;
+    for (; entered < middleware.size(); entered++) {
+        const GlobalMiddleware& current = middleware[entered];
+        if (current.before && !current.before(current.object, request, response)) break;
+    }
+    if (entered == middleware.size() && !shared(request, response)) (*route)(request, response);
+    while (entered--) {
+        const GlobalMiddleware& current = middleware[entered];
+        if (current.after) current.after(current.object, request, response);
+    }
+    return true;
+}
+
+bool Router::shared(HttpRequest* request, HttpResponse* response)
+{
+    // a fresh cached copy, or a request already running for the same key, answers without
+    // running the handler
+    if ((request->opts->CacheTTL || request->opts->CoalesceRequests) &&
+        request->method == HttpMethod::GET && ResponseCache::key(request, response)) {
+        if (request->opts->CacheTTL && ResponseCache::lookup(response)) return true;
+        if (request->opts->CoalesceRequests && !SingleFlight::join(response)) return true;
     }
     return false;
 }
@@ -33,6 +369,7 @@ bool Router::dispatch(WsEvent event, WebSocket* ws) const
         if (wsRoutes[i]->event == event //
             && wsRoutes[i]->path == ws->httpRequest->absolutePath) {
             ws->httpRequest->urlPath = &(wsRoutes[i]->path);
+            if (event == WsEvent::OPEN) ws->opts = &wsRoutes[i]->opts;
             wsRoutes[i]->handler(ws);
             return true;
         }
@@ -40,14 +377,55 @@ bool Router::dispatch(WsEvent event, WebSocket* ws) const
     return false;
 }
 
+bool Router::handles(WsEvent event, const WebSocket* ws) const
+{
+    for (size_t i = 0; i < wsRoutes.size(); i++)
+        if (wsRoutes[i]->event == event && wsRoutes[i]->path == ws->httpRequest->absolutePath)
+            return true;
+    return false;
+}
+
+void Router::publish() { live = true; }
+
+void Router::update(const std::function<void()>& edit)
+{
+    std::lock_guard lock(updateMutex);
+    if (!live) return edit();
+    draft = new Table(*table.load());
+    edit();
+    draft->epoch = Rcu::advance();
+    retired.emplace_back(table.exchange(draft), Rcu::advance());
+    draft = nullptr;
+    if (reclaim()) return;
+    // the loops retry at their quiescent points
+    Rcu::defer(this, [this] {
+        std::unique_lock lock(updateMutex, std::try_to_lock);
+        return lock && reclaim();
+    });
+}
+
+// with the update mutex held, true once nothing is left to free
+bool Router::reclaim()
+{
+    std::erase_if(retired, [](auto& replaced) {
+        if (!Rcu::released(replaced.first->epoch, replaced.second)) return false;
+        delete replaced.first;
+        return true;
+    });
+    return retired.empty();
+}
+
 Router::~Router()
 {
-    for (auto route : httpRoutes)
-        delete route;
+    Rcu::cancel(this);
+    for (auto& replaced : retired)
+        delete replaced.first;
+    delete table.load();
     for (auto route : wsRoutes)
         delete route;
-    httpRoutes.clear();
     wsRoutes.clear();
+    for (auto& erased : middleware)
+        erased.destroy(erased.object);
 }
 
 }; // namespace cW
\ No newline at end of file
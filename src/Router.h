@@ -1,7 +1,13 @@
 #ifndef __CW_HTTP_ROUTER_H_
 #define __CW_HTTP_ROUTER_H_
 
+#include <atomic>
+#include <deque>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <vector>
 #include "HttpRequest.h"
 #include "HttpResponse.h"
@@ -12,27 +18,201 @@ namespace cW {
 typedef std::function<void(HttpRequest* req, HttpResponse*)> HttpHandler;
 typedef std::function<void(WebSocket*)>                      WsHandler;
 
+// the handler is kept as its own type, call knows how to hand it the request
+struct HttpRoute {
+    HttpMethod method;
+    // owned copy for patterns given at runtime, the path views it
+    std::string pattern;
+    UrlPath     path;
+    HttpOpts    opts;
+    void*       handler;
+    void (*call)(const HttpRoute* route, HttpRequest* request, HttpResponse* response);
+    void (*destroy)(void* handler);
+    // unique for the life of the process, set when the route is added. response cache keys use it
+    // since a replaced route's address can come back for another
+    uint64_t id = 0;
+
+    inline void operator()(HttpRequest* request, HttpResponse* response) const
+    {
+        call(this, request, response);
+    }
+    ~HttpRoute() { destroy(handler); }
+};
+
 class Router {
-    struct HttpRoute {
-        HttpMethod  method;
-        HttpHandler handler;
-        UrlPath     path;
+    struct WsRoute {
+        WsEvent       event;
+        WsHandler     handler;
+        UrlPath       path;
+        WebSocketOpts opts;
     };
 
-    struct WsRoute {
-        WsEvent   event;
-        WsHandler handler;
-        UrlPath   path;
+    // radix tree over path segments. a run of static segments is a single node, params and
+    // wildcards get a node each, and routes hang off the node their pattern ends at
+    struct Node {
+        // static segments joined by '/', empty for param and wildcard nodes
+        std::string prefix;
+        size_t      headLength = 0;
+        // sorted by first segment, which differs between siblings
+        std::vector<Node*> statics;
+        // int, float and string, tried in that order
+        Node*      params[3] = {};
+        Node*      wildcard  = nullptr;
+        HttpRoute* routes[HttpMethod::HEAD + 1] = {};
+
+        Node(const std::string_view& prefix = std::string_view());
+        Node(const Node& other);
+        std::string_view head() const { return std::string_view(prefix).substr(0, headLength); }
+        Node*            findStatic(const std::string_view& segment) const;
+        ~Node();
+    };
+
+    struct HostHash {
+        using is_transparent = void;
+        size_t operator()(const std::string_view& host) const
+        {
+            return std::hash<std::string_view>()(host);
+        }
     };
+    typedef std::unordered_map<std::string, Node*, HostHash, std::equal_to<>> HostTable;
+
+    // everything dispatch reads. once the server runs a table is never changed, update() edits a
+    // copy and swaps it in
+    struct Table {
+        uint64_t epoch;
+        // routes for any host without a table of its own
+        Node root;
+        // "api.example.com" and "*.example.com" (keyed by "example.com") get their own trees
+        HostTable hosts;
+        HostTable wildcardHosts;
+        // shared between consecutive tables, a route is freed with the last table holding it
+        std::vector<std::shared_ptr<HttpRoute>> routes;
+
+        Table();
+        Table(const Table& other);
+        ~Table();
+    };
+
+    std::atomic<Table*> table;
+    // the copy being edited inside update()
+    Table*            draft = nullptr;
+    std::atomic<bool> live  = false;
+    std::mutex        updateMutex;
+    // replaced tables and the epoch they were replaced at, freed once no loop can still read
+    // them and no request routed through them is left
+    std::deque<std::pair<Table*, uint64_t>> retired;
+
+    std::vector<WsRoute*> wsRoutes;
+
+    // server-wide middleware, kept as its own type like route handlers. a missing hook is null
+    struct GlobalMiddleware {
+        void* object;
+        bool (*before)(void* object, HttpRequest* request, HttpResponse* response);
+        void (*after)(void* object, HttpRequest* request, HttpResponse* response);
+        void (*destroy)(void* object);
+    };
+    std::vector<GlobalMiddleware> middleware;
+
+    void insertMiddleware(const GlobalMiddleware& erased);
+    // answers from the response cache or a flight already running for the same key, false when
+    // the handler has to run
+    static bool shared(HttpRequest* request, HttpResponse* response);
+
+    Table*             editing();
+    bool               reclaim();
+    static Node*       tree(Table* table, const char* host, bool create);
+    static const Node* select(const Table* table, HttpRequest* request);
+    void               insert(HttpRoute* route, const char* host);
+    static Node*       locate(Node* node, const UrlPath& path, bool create);
+    static Node*       insertStatic(Node* node, std::string_view run);
+    static Node*       findRun(Node* node, std::string_view run);
+    static HttpRoute*  match(const Node* node, std::string_view rest, bool end, HttpMethod method);
+    static HttpRoute*  lookup(const Node* tree, HttpMethod method, std::string_view absPath);
 
-    std::vector<HttpRoute*> httpRoutes;
-    std::vector<WsRoute*>   wsRoutes;
+    template <FixedString pattern, typename Handler>
+    static void callTyped(const HttpRoute* route, HttpRequest* request, HttpResponse* response)
+    {
+        typedef StaticUrlPath<pattern> Path;
+        // the tree checked every segment already, the params only need converting
+        std::string_view segments[Path::nParams + 1];
+        Path::split(request->absolutePath, segments);
+        [&]<size_t... I>(std::index_sequence<I...>) {
+            (*(Handler*)route->handler)(request, response, Path::template param<I>(segments[I])...);
+        }(std::make_index_sequence<Path::nParams>());
+    }
 
   public:
-    void addHttpHandler(const char* route, HttpMethod method, HttpHandler&& handler);
-    void addWsHandler(const char* route, WsEvent event, WsHandler&& handler);
+    Router();
+    // with a host the route only serves requests for it. "*.example.com" covers every
+    // subdomain, an exact name is preferred over a wildcard and a longer wildcard over a shorter
+    void addHttpHandler(const char*     route,
+                        HttpMethod      method,
+                        HttpHandler&&   handler,
+                        const HttpOpts& opts = HttpOpts(),
+                        const char*     host = nullptr);
+    // the pattern is parsed while compiling and the handler is called with the params already
+    // typed, (HttpRequest*, HttpResponse*, int64_t id, std::string_view name) for
+    // "/{d:id}/{s:name}"
+    template <FixedString pattern, typename Handler>
+    void addHttpHandler(HttpMethod      method,
+                        Handler&&       handler,
+                        const HttpOpts& opts = HttpOpts(),
+                        const char*     host = nullptr)
+    {
+        typedef StaticUrlPath<pattern> Path;
+        typedef std::decay_t<Handler>  Stored;
+        static_assert(
+            []<size_t... I>(std::index_sequence<I...>) {
+                return std::is_invocable_v<Stored&, HttpRequest*, HttpResponse*,
+                                           typename Path::template ParamType<I>...>;
+            }(std::make_index_sequence<Path::nParams>()),
+            "Handler must take (HttpRequest*, HttpResponse*) followed by the route params");
+        insert(new HttpRoute{.method  = method,
+                             .path    = UrlPath(Path::path),
+                             .opts    = opts,
+                             .handler = new Stored(std::forward<Handler>(handler)),
+                             .call    = &callTyped<pattern, Stored>,
+                             .destroy = [](void* handler) { delete (Stored*)handler; }},
+               host);
+    }
+    // runs around every http route before the response cache and coalescing are consulted, so
+    // a short circuit in before() holds for cached and shared responses too
+    template <typename Middleware>
+    void addMiddleware(Middleware&& middleware)
+    {
+        typedef std::decay_t<Middleware> Stored;
+        GlobalMiddleware erased{.object  = new Stored(std::forward<Middleware>(middleware)),
+                                .before  = nullptr,
+                                .after   = nullptr,
+                                .destroy = [](void* object) { delete (Stored*)object; }};
+        if constexpr (requires(Stored& m, HttpRequest* q, HttpResponse* r) { m.before(q, r); })
+            erased.before = [](void* object, HttpRequest* request, HttpResponse* response) {
+                return (bool)((Stored*)object)->before(request, response);
+            };
+        if constexpr (requires(Stored& m, HttpRequest* q, HttpResponse* r) { m.after(q, r); })
+            erased.after = [](void* object, HttpRequest* request, HttpResponse* response) {
+                ((Stored*)object)->after(request, response);
+            };
+        insertMiddleware(erased);
+    }
+    // the route registered for exactly this pattern, method and host. false if there was none
+    bool removeHttpHandler(const char* route, HttpMethod method, const char* host = nullptr);
+    void addWsHandler(const char*          route,
+                      WsEvent              event,
+                      WsHandler&&          handler,
+                      const WebSocketOpts& opts = WebSocketOpts());
+    // from here on the loops read the table without locking, http routes only change through
+    // update(), which applies edit to a copy that replaces the table once it returns. requests
+    // already routed finish on the routes they started with
+    void publish();
+    void update(const std::function<void()>& edit);
     bool dispatch(HttpRequest* request, HttpResponse* response) const;
     bool dispatch(WsEvent event, WebSocket* ws) const;
+    // whether the websocket's route has a handler for event
+    bool handles(WsEvent event, const WebSocket* ws) const;
+    // the pattern a path resolves to for the method on hosts without their own routes,
+    // nullptr if nothing matches
+    const UrlPath* find(HttpMethod method, const std::string_view& absPath) const;
     ~Router();
 };
 
@@ -5,35 +5,35 @@
 namespace cW {
 Server::Server() {}
 
-Server&& Server::get(const char* route, HttpHandler&& handler)
+Server&& Server::get(const char* route, HttpHandler&& handler, const HttpOpts& opts)
 {
-    router.addHttpHandler(route, HttpMethod::GET, std::move(handler));
+    router.addHttpHandler(route, HttpMethod::GET, std::move(handler), opts);
     return std::move(*this);
 }
-Server&& Server::post(const char* route, HttpHandler&& handler)
+Server&& Server::post(const char* route, HttpHandler&& handler, const HttpOpts& opts)
 {
-    router.addHttpHandler(route, HttpMethod::POST, std::move(handler));
+    router.addHttpHandler(route, HttpMethod::POST, std::move(handler), opts);
     return std::move(*this);
 }
-Server&& Server::put(const char* route, HttpHandler&& handler)
+Server&& Server::put(const char* route, HttpHandler&& handler, const HttpOpts& opts)
 {
-    router.addHttpHandler(route, HttpMethod::PUT, std::move(handler));
+    router.addHttpHandler(route, HttpMethod::PUT, std::move(handler), opts);
     return std::move(*this);
 }
-Server&& Server::del(const char* route, HttpHandler&& handler)
+Server&& Server::del(const char* route, HttpHandler&& handler, const HttpOpts& opts)
 {
-    router.addHttpHandler(route, HttpMethod::DEL, std::move(handler));
+    router.addHttpHandler(route, HttpMethod::DEL, std::move(handler), opts);
     return std::move(*this);
 }
-Server&& Server::head(const char* route, HttpHandler&& handler)
+Server&& Server::head(const char* route, HttpHandler&& handler, const HttpOpts& opts)
 {
-    router.addHttpHandler(route, HttpMethod::HEAD, std::move(handler));
+    router.addHttpHandler(route, HttpMethod::HEAD, std::move(handler), opts);
     return std::move(*this);
 }
-Server&& Server::open(const char* route, WsHandler&& handler)
+Server&& Server::open(const char* route, WsHandler&& handler, const WebSocketOpts& opts)
 {
     activeWsRoute = route;
-    router.addWsHandler(route, WsEvent::OPEN, std::move(handler));
+    router.addWsHandler(route, WsEvent::OPEN, std::move(handler), opts);
     return std::move(*this);
 }
 
@@ -59,7 +59,33 @@ Server&& Server::close(WsHandler&& handler)
 Server&& Server::message(WsHandler&& handler)
 {
     assert(activeWsRoute && "No WsSocket route set.");
-    router.addWsHandler(activeWsRoute, WsEvent::CLOSE, std::move(handler));
+    router.addWsHandler(activeWsRoute, WsEvent::MESSAGE, std::move(handler));
+    return std::move(*this);
+}
+
+Server&& Server::stream(WsHandler&& handler)
+{
+    assert(activeWsRoute && "No WsSocket route set.");
+    router.addWsHandler(activeWsRoute, WsEvent::STREAM, std::move(handler));
+    return std::move(*this);
+}
+
+Server&& Server::drain(WsHandler&& handler)
+{
+    assert(activeWsRoute && "No WsSocket route set.");
+    router.addWsHandler(activeWsRoute, WsEvent::DRAIN, std::move(handler));
+    return std::move(*this);
+}
+
+Server&& Server::remove(const char* route, HttpMethod method, const char* host)
+{
+    router.removeHttpHandler(route, method, host);
+    return std::move(*this);
+}
+
+Server&& Server::update(const std::function<void(Server&)>& edit)
+{
+    router.update([&] { edit(*this); });
     return std::move(*this);
 }
 
@@ -78,27 +104,48 @@ Server&& Server::listen(std::initializer_list<short> ports)
 Server&& Server::run(MTMode mtMode, int nThreads)
 {
     if (nThreads < 0) nThreads = std::thread::hardware_concurrency();
+    router.publish();
     if (mtMode == ONE_LISTENER) {
         Poll poll(this, true);
         for (auto port : ports)
             poll.add(ListenSocket::create("::", port));
+        polls = {&poll};
         poll.runLoop(nThreads);
     }
     else {
+        // every loop exists before the first one runs, so publish never sees the list change
+        std::vector<std::unique_ptr<Poll>>        loops;
         std::vector<std::unique_ptr<std::thread>> threads;
+        for (int i = 0; i < nThreads; i++) {
+            loops.push_back(std::make_unique<Poll>(this, false));
+            for (auto port : ports)
+                loops.back()->add(ListenSocket::create("::", port, true));
+            polls.push_back(loops.back().get());
+        }
         for (int i = 0; i < nThreads; i++)
-            threads.push_back(std::make_unique<std::thread>([this] {
-                Poll poll(this, false);
-                for (auto port : ports) {
-                    poll.add(ListenSocket::create("::", port, true));
-                }
-                poll.runLoop();
-            }));
+            threads.push_back(
+                std::make_unique<std::thread>([poll = loops[i].get()] { poll->runLoop(); }));
         for (int i = 0; i < nThreads; i++)
             if (threads[i]->joinable()) threads[i]->join();
     }
+    polls.clear();
     return std::move(*this);
 }
 
+void Server::publish(const std::string_view& topic,
+                     const std::string_view& message,
+                     WsOpcode                opcode) const
+{
+    publish(topic, WsSharedMessage(opcode, message));
+}
+
+void Server::publish(const std::string_view& topic, const WsSharedMessage& message) const
+{
+    assert((message.opcode() == WsOpcode::Text || message.opcode() == WsOpcode::Binary) &&
+           "Only data messages can be published");
+    for (Poll* poll : polls)
+        poll->publish(topic, message.frame);
+}
+
 Server::~Server() {}
 }; // namespace cW
\ No newline at end of file
@@ -3,40 +3,94 @@
 
 #include <thread>
 #include <initializer_list>
+#include "FrameBuffer.h"
+#include "Middleware.h"
 #include "Router.h"
 
 namespace cW {
 
 class ClientSocketSet;
+class Poll;
 
 enum MTMode { ONE_LISTENER, MULTIPLE_LISTENER };
 
+template <typename... Middleware>
+class Scope;
+
 class Server {
     friend class HttpSession;
+    friend class Http2Session;
     friend class WebSocketSession;
+    template <typename... Middleware>
+    friend class Scope;
 
     Router                      router;
     const char*                 activeWsRoute = nullptr;
     std::vector<unsigned short> ports;
+    // the running loops, fixed before any of them starts
+    std::vector<Poll*> polls;
 
     inline bool dispatch(HttpRequest* req, HttpResponse* res) const;
     inline bool dispatch(WsEvent event, WebSocket* ws) const;
+    inline bool handles(WsEvent event, const WebSocket* ws) const;
 
   public:
     Server();
-    Server&& get(const char* route, HttpHandler&& handler);
-    Server&& post(const char* route, HttpHandler&& handler);
-    Server&& put(const char* route, HttpHandler&& handler);
-    Server&& del(const char* route, HttpHandler&& handler);
-    Server&& head(const char* route, HttpHandler&& handler);
-    Server&& open(const char* route, WsHandler&& handler);
+    Server&& get(const char* route, HttpHandler&& handler, const HttpOpts& opts = HttpOpts());
+    Server&& post(const char* route, HttpHandler&& handler, const HttpOpts& opts = HttpOpts());
+    Server&& put(const char* route, HttpHandler&& handler, const HttpOpts& opts = HttpOpts());
+    Server&& del(const char* route, HttpHandler&& handler, const HttpOpts& opts = HttpOpts());
+    Server&& head(const char* route, HttpHandler&& handler, const HttpOpts& opts = HttpOpts());
+    // compile time routes, get<"/users/{d:id}">([](HttpRequest*, HttpResponse*, int64_t id) {})
+    template <FixedString route, typename Handler>
+    Server&& get(Handler&& handler, const HttpOpts& opts = HttpOpts());
+    template <FixedString route, typename Handler>
+    Server&& post(Handler&& handler, const HttpOpts& opts = HttpOpts());
+    template <FixedString route, typename Handler>
+    Server&& put(Handler&& handler, const HttpOpts& opts = HttpOpts());
+    template <FixedString route, typename Handler>
+    Server&& del(Handler&& handler, const HttpOpts& opts = HttpOpts());
+    template <FixedString route, typename Handler>
+    Server&& head(Handler&& handler, const HttpOpts& opts = HttpOpts());
+    // middleware for every http route, added before or after it. it runs outermost, in the order
+    // given, and ahead of the response cache and request coalescing. only before run
+    template <typename... Middleware>
+    Server&& use(Middleware&&... middleware);
+    // routes added through the returned scope run the middleware around their handler, inside
+    // the server-wide middleware. they can't set CacheTTL or CoalesceRequests
+    template <typename... Middleware>
+    Scope<std::decay_t<Middleware>...> group(Middleware&&... middleware);
+    // routes added through the returned scope only answer requests for the host, see
+    // Router::addHttpHandler for wildcards
+    Scope<> host(const char* name);
+    // drops the http route with exactly this pattern
+    Server&& remove(const char* route, HttpMethod method, const char* host = nullptr);
+    // once running, http routes only change inside edit. its changes go live together when it
+    // returns, requests already routed are not affected
+    Server&& update(const std::function<void(Server&)>& edit);
+    Server&& open(const char*          route,
+                  WsHandler&&          handler,
+                  const WebSocketOpts& opts = WebSocketOpts());
     Server&& ping(WsHandler&& handler);
     Server&& pong(WsHandler&& handler);
     Server&& close(WsHandler&& handler);
     Server&& message(WsHandler&& handler);
+    // the route's data messages are handed over in pieces as they arrive instead of whole to
+    // message, WsMessage::last marks the end of one. see WebSocketOpts::MaxMessageLength
+    Server&& stream(WsHandler&& handler);
+    // a congested websocket is back under half its MaxBackpressure
+    Server&& drain(WsHandler&& handler);
     Server&& listen(unsigned short port);
     Server&& listen(std::initializer_list<short> ports);
     Server&& run(MTMode mtMode = MTMode::ONE_LISTENER, int nThreads = -1);
+    // from any thread once running: frames message once and sends it to every websocket
+    // subscribed to topic, on all loops. it goes out as a single frame whatever MaxPayloadLength
+    // the routes have
+    void publish(const std::string_view& topic,
+                 const std::string_view& message,
+                 WsOpcode                opcode = WsOpcode::Text) const;
+    // the frame already made, shared with every other send of it
+    void publish(const std::string_view& topic, const WsSharedMessage& message) const;
     ~Server();
 };
 
@@ -45,6 +99,150 @@ bool Server::dispatch(HttpRequest* req, HttpResponse* res) const
     return router.dispatch(req, res);
 }
 bool Server::dispatch(WsEvent event, WebSocket* ws) const { return router.dispatch(event, ws); }
+bool Server::handles(WsEvent event, const WebSocket* ws) const
+{
+    return router.handles(event, ws);
+}
+
+template <FixedString route, typename Handler>
+Server&& Server::get(Handler&& handler, const HttpOpts& opts)
+{
+    router.addHttpHandler<route>(HttpMethod::GET, std::forward<Handler>(handler), opts);
+    return std::move(*this);
+}
+template <FixedString route, typename Handler>
+Server&& Server::post(Handler&& handler, const HttpOpts& opts)
+{
+    router.addHttpHandler<route>(HttpMethod::POST, std::forward<Handler>(handler), opts);
+    return std::move(*this);
+}
+template <FixedString route, typename Handler>
+Server&& Server::put(Handler&& handler, const HttpOpts& opts)
+{
+    router.addHttpHandler<route>(HttpMethod::PUT, std::forward<Handler>(handler), opts);
+    return std::move(*this);
+}
+template <FixedString route, typename Handler>
+Server&& Server::del(Handler&& handler, const HttpOpts& opts)
+{
+    router.addHttpHandler<route>(HttpMethod::DEL, std::forward<Handler>(handler), opts);
+    return std::move(*this);
+}
+template <FixedString route, typename Handler>
+Server&& Server::head(Handler&& handler, const HttpOpts& opts)
+{
+    router.addHttpHandler<route>(HttpMethod::HEAD, std::forward<Handler>(handler), opts);
+    return std::move(*this);
+}
+
+// composed with each handler as it is registered, nothing is looked up per request
+template <typename... Middleware>
+class Scope {
+    Server&                 server;
+    Pipeline<Middleware...> pipeline;
+    const char*             host;
+
+    // the chain is compiled into the handler, which a cached or shared response never runs. an
+    // auth check there would be skipped, such routes need the middleware through Server::use
+    static void checkShared(const HttpOpts& opts)
+    {
+        if (sizeof...(Middleware) && (opts.CacheTTL || opts.CoalesceRequests))
+            throw std::runtime_error("Cached or coalesced routes can't have scoped middleware");
+    }
+
+    template <FixedString route, typename Handler>
+    Scope&& add(HttpMethod method, Handler&& handler, const HttpOpts& opts)
+    {
+        checkShared(opts);
+        server.router.addHttpHandler<route>(method, pipeline(std::forward<Handler>(handler)), opts,
+                                            host);
+        return std::move(*this);
+    }
+    Scope&& add(const char* route, HttpMethod method, HttpHandler&& handler, const HttpOpts& opts)
+    {
+        checkShared(opts);
+        server.router.addHttpHandler(route, method, pipeline(std::move(handler)), opts, host);
+        return std::move(*this);
+    }
+
+  public:
+    Scope(Server& server, Pipeline<Middleware...>&& pipeline, const char* host = nullptr)
+        : server(server), pipeline(std::move(pipeline)), host(host)
+    {
+    }
+
+    Scope&& get(const char* route, HttpHandler&& handler, const HttpOpts& opts = HttpOpts())
+    {
+        return add(route, HttpMethod::GET, std::move(handler), opts);
+    }
+    Scope&& post(const char* route, HttpHandler&& handler, const HttpOpts& opts = HttpOpts())
+    {
+        return add(route, HttpMethod::POST, std::move(handler), opts);
+    }
+    Scope&& put(const char* route, HttpHandler&& handler, const HttpOpts& opts = HttpOpts())
+    {
+        return add(route, HttpMethod::PUT, std::move(handler), opts);
+    }
+    Scope&& del(const char* route, HttpHandler&& handler, const HttpOpts& opts = HttpOpts())
+    {
+        return add(route, HttpMethod::DEL, std::move(handler), opts);
+    }
+    Scope&& head(const char* route, HttpHandler&& handler, const HttpOpts& opts = HttpOpts())
+    {
+        return add(route, HttpMethod::HEAD, std::move(handler), opts);
+    }
+    template <FixedString route, typename Handler>
+    Scope&& get(Handler&& handler, const HttpOpts& opts = HttpOpts())
+    {
+        return add<route>(HttpMethod::GET, std::forward<Handler>(handler), opts);
+    }
+    template <FixedString route, typename Handler>
+    Scope&& post(Handler&& handler, const HttpOpts& opts = HttpOpts())
+    {
+        return add<route>(HttpMethod::POST, std::forward<Handler>(handler), opts);
+    }
+    template <FixedString route, typename Handler>
+    Scope&& put(Handler&& handler, const HttpOpts& opts = HttpOpts())
+    {
+        return add<route>(HttpMethod::PUT, std::forward<Handler>(handler), opts);
+    }
+    template <FixedString route, typename Handler>
+    Scope&& del(Handler&& handler, const HttpOpts& opts = HttpOpts())
+    {
+        return add<route>(HttpMethod::DEL, std::forward<Handler>(handler), opts);
+    }
+    template <FixedString route, typename Handler>
+    Scope&& head(Handler&& handler, const HttpOpts& opts = HttpOpts())
+    {
+        return add<route>(HttpMethod::HEAD, std::forward<Handler>(handler), opts);
+    }
+
+    // nested scope, its middleware runs inside this one's
+    template <typename... More>
+    Scope<Middleware..., std::decay_t<More>...> use(More&&... more)
+    {
+        return Scope<Middleware..., std::decay_t<More>...>(
+            server, pipeline.with(std::forward<More>(more)...), host);
+    }
+    // back to the server, to listen and run
+    Server&& done() { return std::move(server); }
+};
+
+template <typename... Middleware>
+Server&& Server::use(Middleware&&... middleware)
+{
+    (router.addMiddleware(std::forward<Middleware>(middleware)), ...);
+    return std::move(*this);
+}
+
+template <typename... Middleware>
+Scope<std::decay_t<Middleware>...> Server::group(Middleware&&... middleware)
+{
+    return Scope<std::decay_t<Middleware>...>(*this,
+                                              chain(std::forward<Middleware>(middleware)...));
+}
+
+inline Scope<> Server::host(const char* name) { return Scope<>(*this, Pipeline<>(), name); }
 
 } // namespace cW
 
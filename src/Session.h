@@ -8,7 +8,7 @@ class Session {
     friend class Server;
 
   protected:
-    enum Type { HTTP, WS };
+    enum Type { HTTP, HTTP2, WS };
     ClientSocket* socket;
     Type          type;
     Session(ClientSocket* socket, Type type);
@@ -18,6 +18,7 @@ class Session {
     virtual void onWritable()                         = 0;
     virtual void onData(const std::string_view& data) = 0;
     virtual bool shouldEnd()                          = 0;
+    virtual ~Session()                                = default;
 };
 } // namespace cW
 
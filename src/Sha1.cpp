@@ -0,0 +1,97 @@
+#include "Sha1.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace cW {
+
+namespace {
+inline uint32_t rotl(uint32_t value, int bits) { return (value << bits) | (value >> (32 - bits)); }
+} // namespace
+
+Sha1::Sha1() : state{0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0} {}
+
+void Sha1::transform(const uint8_t* data)
+{
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)data[4 * i] << 24 | (uint32_t)data[4 * i + 1] << 16 |
+               (uint32_t)data[4 * i + 2] << 8 | (uint32_t)data[4 * i + 3];
+    for (int i = 16; i < 80; i++)
+        w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        }
+        else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        }
+        else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        }
+        else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+        e             = d;
+        d             = c;
+        c             = rotl(b, 30);
+        b             = a;
+        a             = temp;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+Sha1& Sha1::update(const std::string_view& data)
+{
+    const uint8_t* bytes = (const uint8_t*)data.data();
+    size_t         size  = data.size();
+    length += size;
+    if (blockLength) {
+        size_t toCopy = std::min(size, sizeof(block) - blockLength);
+        std::memcpy(block + blockLength, bytes, toCopy);
+        blockLength += toCopy;
+        bytes += toCopy;
+        size -= toCopy;
+        if (blockLength < sizeof(block)) return *this;
+        transform(block);
+        blockLength = 0;
+    }
+    for (; size >= sizeof(block); bytes += sizeof(block), size -= sizeof(block))
+        transform(bytes);
+    std::memcpy(block, bytes, size);
+    blockLength = size;
+    return *this;
+}
+
+void Sha1::finish(uint8_t (&digest)[DigestLength])
+{
+    uint64_t bits = length * 8;
+    // a one bit, zeros up to 56 mod 64 and the length in bits, big endian
+    block[blockLength++] = 0x80;
+    if (blockLength > 56) {
+        std::memset(block + blockLength, 0, sizeof(block) - blockLength);
+        transform(block);
+        blockLength = 0;
+    }
+    std::memset(block + blockLength, 0, 56 - blockLength);
+    for (int i = 0; i < 8; i++)
+        block[56 + i] = (uint8_t)(bits >> (56 - 8 * i));
+    transform(block);
+    for (int i = 0; i < 5; i++)
+        for (int j = 0; j < 4; j++)
+            digest[4 * i + j] = (uint8_t)(state[i] >> (24 - 8 * j));
+}
+
+}; // namespace cW
@@ -0,0 +1,30 @@
+#ifndef __CW_SHA1_H_
+#define __CW_SHA1_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace cW {
+
+// incremental SHA-1 kept entirely on the stack. only here because the websocket handshake asks
+// for it, not for anything that needs a secure hash
+class Sha1 {
+    uint32_t state[5];
+    uint8_t  block[64];
+    size_t   blockLength = 0;
+    uint64_t length      = 0;
+
+    void transform(const uint8_t* data);
+
+  public:
+    static constexpr size_t DigestLength = 20;
+
+    Sha1();
+    Sha1& update(const std::string_view& data);
+    void  finish(uint8_t (&digest)[DigestLength]);
+};
+
+}; // namespace cW
+
+#endif
@@ -0,0 +1,122 @@
+#include "SingleFlight.h"
+
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "ClientSocket.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "Poll.h"
+#include "Router.h"
+
+namespace cW {
+
+struct SingleFlight::State {
+    std::string key;
+
+    std::mutex           mtx;
+    bool                 landed = false;
+    ResponseCache::Entry entry;
+    // followers, woken on their own loops when the leader lands
+    struct Waiter {
+        HttpResponse* response;
+        ClientSocket* socket;
+        bool          parked;
+    };
+    std::vector<Waiter> waiters;
+};
+
+namespace {
+struct FlightShard {
+    std::mutex                                                 mtx;
+    std::unordered_map<std::string_view, SingleFlight::Flight> flights;
+};
+const size_t shardCount = 16;
+FlightShard  shards[shardCount];
+
+inline FlightShard& shardOf(const std::string_view& key)
+{
+    return shards[std::hash<std::string_view>()(key) % shardCount];
+}
+} // namespace
+
+bool SingleFlight::join(HttpResponse* response)
+{
+    FlightShard&    shard = shardOf(response->cacheKey);
+    std::lock_guard lock(shard.mtx);
+    if (auto itr = shard.flights.find(response->cacheKey); itr != shard.flights.end()) {
+        response->flight = itr->second;
+        return false;
+    }
+    auto flight      = std::make_shared<State>();
+    flight->key      = response->cacheKey;
+    response->flight = flight;
+    response->leader = true;
+    shard.flights.emplace(flight->key, flight);
+    return true;
+}
+
+bool SingleFlight::wait(HttpRequest*  request,
+                        HttpResponse* response,
+                        ClientSocket* socket,
+                        bool          park)
+{
+    if (response->leader) return false;
+    Flight flight  = response->flight;
+    auto   waiting = [response](const State::Waiter& waiter) {
+        return waiter.response == response;
+    };
+    {
+        std::lock_guard lock(flight->mtx);
+        if (!flight->landed) {
+            if (std::find_if(flight->waiters.begin(), flight->waiters.end(), waiting) ==
+                flight->waiters.end())
+                flight->waiters.push_back({response, socket, park});
+            // a wake queued for it has to be dropped if it closes first
+            socket->waited = true;
+            if (park) socket->park = ClientSocket::PARKING;
+            return true;
+        }
+        std::erase_if(flight->waiters, waiting);
+        response->cached = flight->entry;
+    }
+    response->flight = nullptr;
+    if (!response->cached) {
+        request->inHandler = true;
+        (*response->route)(request, response);
+        request->inHandler = false;
+    }
+    return false;
+}
+
+void SingleFlight::land(HttpResponse* response, const ResponseCache::Entry& entry)
+{
+    Flight flight = std::move(response->flight);
+    response->leader = false;
+    {
+        // later requests start a flight of their own, or find the entry cached
+        FlightShard&    shard = shardOf(flight->key);
+        std::lock_guard lock(shard.mtx);
+        shard.flights.erase(flight->key);
+    }
+    std::lock_guard lock(flight->mtx);
+    flight->landed = true;
+    flight->entry  = entry;
+    for (auto& [waiter, socket, parked] : flight->waiters)
+        if (parked)
+            socket->poll->wake(socket);
+        else
+            socket->poll->notify(socket);
+    flight->waiters.clear();
+}
+
+void SingleFlight::leave(HttpResponse* response)
+{
+    if (response->leader) return land(response, nullptr);
+    std::lock_guard lock(response->flight->mtx);
+    std::erase_if(response->flight->waiters,
+                  [response](auto& waiter) { return waiter.response == response; });
+}
+
+}; // namespace cW
@@ -0,0 +1,40 @@
+#ifndef __CW_SINGLE_FLIGHT_H_
+#define __CW_SINGLE_FLIGHT_H_
+
+#include <memory>
+#include "ResponseCache.h"
+
+namespace cW {
+
+class ClientSocket;
+class HttpRequest;
+class HttpResponse;
+
+// request coalescing for routes with HttpOpts::CoalesceRequests. the first GET for a cache key
+// leads and runs the handler, identical requests arriving on any thread before it answers follow
+// it and are sent the same serialized response
+class SingleFlight {
+    struct State;
+
+  public:
+    typedef std::shared_ptr<State> Flight;
+
+    // true if the response leads the flight for its key and the handler should run
+    static bool join(HttpResponse* response);
+    // follower: true while the leader is busy. a parked socket sleeps until the leader answers,
+    // one that can't park (an http/2 stream shares it with others) stays awake and gets an
+    // onWritable round then. once it returns false the response holds the shared entry, or the
+    // route handler ran because the leader's response couldn't be shared
+    static bool wait(HttpRequest*  request,
+                     HttpResponse* response,
+                     ClientSocket* socket,
+                     bool          park = true);
+    // leader: hands the entry (null if the response can't be shared) to every follower
+    static void land(HttpResponse* response, const ResponseCache::Entry& entry);
+    // the response goes away still attached to its flight
+    static void leave(HttpResponse* response);
+};
+
+}; // namespace cW
+
+#endif
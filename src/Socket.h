@@ -15,7 +15,7 @@ namespace cW {
 
 struct Socket {
     friend class Poll;
-    enum Type { LISTEN, ACCEPT };
+    enum Type { LISTEN, ACCEPT, WAKE, TIMER };
 
     const Type   type;
     const SOCKET fd;
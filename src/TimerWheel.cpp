@@ -0,0 +1,53 @@
+#include "TimerWheel.h"
+
+#include "WebSocketSession.h"
+
+namespace cW {
+
+// fills the hole with the slot's last entry and tells that one where it moved
+void TimerWheel::take(WebSocketSession* session)
+{
+    Entry&                          entry = session->timer;
+    std::vector<WebSocketSession*>& slot  = slots[entry.slot];
+    slot[entry.index]                     = slot.back();
+    slot[entry.index]->timer.index        = entry.index;
+    slot.pop_back();
+    entry.slot = None;
+}
+
+void TimerWheel::schedule(WebSocketSession* session, uint32_t seconds)
+{
+    std::lock_guard lock(mutex);
+    Entry&          entry = session->timer;
+    if (entry.slot != None) take(session);
+    entry.deadline = tick() + seconds;
+    entry.slot     = entry.deadline % Slots;
+    entry.index    = slots[entry.slot].size();
+    slots[entry.slot].push_back(session);
+}
+
+void TimerWheel::cancel(WebSocketSession* session)
+{
+    std::lock_guard lock(mutex);
+    if (session->timer.slot != None) take(session);
+}
+
+void TimerWheel::advance(std::vector<ClientSocket*>& due)
+{
+    std::lock_guard lock(mutex);
+    uint32_t        current = now.fetch_add(1, std::memory_order_relaxed) + 1;
+    auto&           slot    = slots[current % Slots];
+    // deadlines a lap or more away stay for a later one
+    for (size_t i = 0; i < slot.size();) {
+        WebSocketSession* session = slot[i];
+        if ((int32_t)(session->timer.deadline - current) > 0) {
+            i++;
+            continue;
+        }
+        take(session);
+        session->timer.due = true;
+        due.push_back(session->socket);
+    }
+}
+
+}; // namespace cW
@@ -0,0 +1,51 @@
+#ifndef __CW_TIMER_WHEEL_H_
+#define __CW_TIMER_WHEEL_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace cW {
+
+class ClientSocket;
+class WebSocketSession;
+
+// second resolution deadlines of the websockets on one loop. a session sits in the slot of its
+// deadline, a tick visits just that slot, so connections cost nothing until they are due
+class TimerWheel {
+  public:
+    static const size_t Slots = 64;
+    static const size_t None  = SIZE_MAX;
+
+    // kept by the session, so it is taken out in constant time
+    struct Entry {
+        size_t   slot  = None;
+        size_t   index = 0;
+        uint32_t deadline;
+        // taken out of its slot, the next time its socket is served runs its timer
+        std::atomic<bool> due = false;
+    };
+
+  private:
+    // only contended by the threads of a shared poll
+    std::mutex                     mutex;
+    std::vector<WebSocketSession*> slots[Slots];
+    std::atomic<uint32_t>          now = 0;
+
+    void take(WebSocketSession* session);
+
+  public:
+    // seconds since the loop started
+    inline uint32_t tick() const { return now.load(std::memory_order_relaxed); }
+    // replaces the session's deadline
+    void schedule(WebSocketSession* session, uint32_t seconds);
+    void cancel(WebSocketSession* session);
+    // one second further, the sockets of the sessions now due are added to due
+    void advance(std::vector<ClientSocket*>& due);
+};
+
+}; // namespace cW
+
+#endif
@@ -1,19 +1,13 @@
 #include "UrlPath.h"
 
-namespace cW {
-UrlParam::UrlParam(const void* val, size_t size, Type type) : type(type), size(size)
-{
-    data = malloc(size + (int)(type == Type::STRING));
-    std::memcpy(data, val, size);
-    if (type == Type::STRING) ((char*)data)[size] = '\0';
-}
-
-UrlParam::~UrlParam() { free(data); }
+#include <algorithm>
 
+namespace cW {
 UrlPath::UrlPath(const std::string_view& absPath)
 {
     assert(absPath[0] == '/' && "Absolute path must start with /");
-    size_t len = absPath.size();
+    size_t len     = absPath.size();
+    size_t nParams = 0;
     for (size_t i = 1; i < len;) {
         size_t next    = std::min(absPath.find('/', i), len);
         auto   segment = absPath.substr(i, next - i);
@@ -29,6 +23,8 @@ UrlPath::UrlPath(const std::string_view& absPath)
                 case 'd': level.type = UrlLevel::Type::PARAM_INT; break;
                 case 'f': level.type = UrlLevel::Type::PARAM_FLOAT; break;
             }
+            // UrlParams has room for this many, the typed routes check it while compiling
+            if (++nParams > MaxUrlParams) throw std::runtime_error("Too many params in route");
             levels.push_back(level);
         }
         // wildcard
@@ -65,12 +61,14 @@ bool UrlPath::operator==(const std::string_view& absPath) const
                 char* end;
             case UrlLevel::Type::PARAM_INT: {
                 for (size_t j = i; j < next; j++)
-                    if (!isdigit(path[i])) return false;
+                    if (!isdigit(path[j])) return false;
+                int64_t value;
+                if (std::from_chars(path + i, path + next, value).ec != std::errc()) return false;
                 break;
             }
             case UrlLevel::Type::PARAM_FLOAT: {
                 for (size_t j = i; j < next; j++)
-                    if (!isdigit(path[i]) && path[i] != '.') return false;
+                    if (!isdigit(path[j]) && path[j] != '.') return false;
                 break;
             }
         }
@@ -80,35 +78,28 @@ bool UrlPath::operator==(const std::string_view& absPath) const
     return in_levels == levels.size() || last_match_was_wildcard;
 }
 
-std::map<std::string_view, UrlParam*> UrlPath::parseParams(const std::string_view& absPath) const
+void UrlPath::parseParams(const std::string_view& absPath, UrlParams& params) const
 {
-    // assert(*this == absPath && "Must match url to parse params");
-    const char*                           path = absPath.data();
-    const size_t                          len  = absPath.size();
-    std::map<std::string_view, UrlParam*> params;
+    const size_t len = absPath.size();
+    params.count     = 0;
     for (size_t i = 1, level = 0; i < len && level < levels.size(); level++) {
         size_t next = std::min(absPath.find('/', i), len);
         switch (levels[level].type) {
-            case UrlLevel::Type::PARAM_INT: {
-                int64_t value = strtoll(path + i, nullptr, 10);
-                params.insert({levels[level].val,
-                               new UrlParam(&value, sizeof(int64_t), UrlParam::Type::INT)});
+            case UrlLevel::Type::PARAM_INT:
+                params.items[params.count++] = {levels[level].val, absPath.substr(i, next - i),
+                                                UrlParam::Type::INT};
                 break;
-            }
-            case UrlLevel::Type::PARAM_FLOAT: {
-                long double value = strtold(path + i, nullptr);
-                params.insert({levels[level].val,
-                               new UrlParam(&value, sizeof(long double), UrlParam::Type::FLOAT)});
+            case UrlLevel::Type::PARAM_FLOAT:
+                params.items[params.count++] = {levels[level].val, absPath.substr(i, next - i),
+                                                UrlParam::Type::FLOAT};
                 break;
-            }
             case UrlLevel::Type::PARAM_STRING:
-                params.insert(
-                    {levels[level].val, new UrlParam(path + i, next - i, UrlParam::Type::STRING)});
+                params.items[params.count++] = {levels[level].val, absPath.substr(i, next - i),
+                                                UrlParam::Type::STRING};
                 break;
         }
         i = next + 1;
     }
-    return params;
 }
 
 UrlPath::~UrlPath() {}
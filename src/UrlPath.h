@@ -1,47 +1,59 @@
 #ifndef __CW_URL_PATH_H_
-#define __CW_URL_PATh_H_
+#define __CW_URL_PATH_H_
 
+#include <array>
+#include <charconv>
 #include <vector>
 #include <map>
+#include <memory_resource>
 #include <string>
 #include <stdexcept>
+#include "Arena.h"
 #include "Utils.h"
 namespace cW {
 
-struct UrlParam {
-    friend struct UrlPath;
+// params in a single route pattern
+inline constexpr size_t MaxUrlParams = 8;
 
-  private:
+// a param of the matched route, viewing its segment of the request path. numbers are converted
+// when they are asked for
+struct UrlParam {
     enum Type { INT, FLOAT, STRING };
-    void*  data;
-    Type   type;
-    size_t size;
 
-    UrlParam(const void* val, size_t size, Type type);
+    std::string_view name;
+    std::string_view value;
+    Type             type;
 
-  public:
     template <typename T>
     requires std::is_arithmetic_v<T> const T get() const
     {
         if (type == Type::STRING) throw std::runtime_error("Requesting number from string param");
-        switch (type) {
-            case INT: return (T)(*(static_cast<int64_t*>(data)));
-            case FLOAT: return (T)(*(static_cast<long double*>(data)));
+        if (type == Type::INT) {
+            int64_t number = 0;
+            std::from_chars(value.data(), value.data() + value.size(), number);
+            return (T)number;
         }
-        return 0;
+        long double number = 0;
+        std::from_chars(value.data(), value.data() + value.size(), number);
+        return (T)number;
     }
 
+    // the text as it appears in the path
     template <typename T = std::string>
-    requires std::is_convertible_v<std::string, T> const T get() const
+    requires std::is_convertible_v<std::string, T> const T get() const { return T(value); }
+};
+
+// the params of one request, stored inline in the order of the pattern
+struct UrlParams {
+    UrlParam items[MaxUrlParams];
+    size_t   count = 0;
+
+    inline const UrlParam* find(const std::string_view& name) const
     {
-        switch (type) {
-            case STRING: return std::string((const char*)data);
-            case INT: return std::to_string(*(static_cast<int64_t*>(data)));
-            case FLOAT: return std::to_string(*(static_cast<long double*>(data)));
-        }
-        return "";
+        for (size_t i = 0; i < count; i++)
+            if (items[i].name == name) return &items[i];
+        return nullptr;
     }
-    ~UrlParam();
 };
 
 class UrlPath {
@@ -55,11 +67,132 @@ class UrlPath {
     };
     std::vector<UrlLevel> levels;
     UrlPath(const std::string_view& absPath);
-    bool                                  operator==(const std::string_view& absPath) const;
-    std::map<std::string_view, UrlParam*> parseParams(const std::string_view& absPath) const;
+    bool operator==(const std::string_view& absPath) const;
+    // slices the params out of a path this pattern matched
+    void parseParams(const std::string_view& absPath, UrlParams& params) const;
     ~UrlPath();
 };
 
+// checks a route pattern the way UrlPath would read it: segments are never empty, params are
+// {d:name}, {f:name} or {s:name} with distinct names, and braces appear nowhere else
+constexpr bool validUrlPattern(std::string_view pattern)
+{
+    if (pattern.empty() || pattern[0] != '/') return false;
+    pattern.remove_prefix(1);
+    if (!pattern.empty() && pattern.back() == '/') pattern.remove_suffix(1);
+    std::string_view rest = pattern;
+    while (!rest.empty()) {
+        size_t           slash   = rest.find('/');
+        std::string_view segment = rest.substr(0, slash);
+        rest.remove_prefix(slash == std::string_view::npos ? rest.size() : slash + 1);
+        if (segment.empty() || (slash != std::string_view::npos && rest.empty())) return false;
+        if (segment[0] != '{') {
+            if (segment.find_first_of("{}") != std::string_view::npos) return false;
+            continue;
+        }
+        if (segment.size() < 5 || (segment[1] != 'd' && segment[1] != 'f' && segment[1] != 's') ||
+            segment[2] != ':' || segment.back() != '}')
+            return false;
+        std::string_view name = segment.substr(3, segment.size() - 4);
+        if (name.find_first_of("{}") != std::string_view::npos) return false;
+        // names must not repeat further on
+        for (std::string_view after = rest; !after.empty();) {
+            size_t           next  = after.find('/');
+            std::string_view other = after.substr(0, next);
+            after.remove_prefix(next == std::string_view::npos ? after.size() : next + 1);
+            if (other.size() > 4 && other[0] == '{' && other.substr(3, other.size() - 4) == name)
+                return false;
+        }
+    }
+    return true;
+}
+
+// a route pattern given as a template argument, parsed and checked while compiling. params are
+// handed out already converted: {d:} as int64_t, {f:} as double and {s:} as a view into the path
+template <FixedString pattern>
+struct StaticUrlPath {
+    static_assert(validUrlPattern((const char*)pattern), "Malformed route pattern");
+
+    typedef UrlPath::UrlLevel::Type Type;
+
+    static constexpr std::string_view path = (const char*)pattern;
+
+    static constexpr size_t nLevels = [] {
+        std::string_view rest = path.substr(1);
+        if (!rest.empty() && rest.back() == '/') rest.remove_suffix(1);
+        return rest.empty() ? 0 : count_char('/', rest.data(), rest.size()) + 1;
+    }();
+
+    static constexpr std::array<Type, nLevels> levels = [] {
+        std::array<Type, nLevels> levels{};
+        std::string_view          rest = path.substr(1);
+        for (size_t i = 0; i < nLevels; i++) {
+            size_t           slash   = rest.find('/');
+            std::string_view segment = rest.substr(0, slash);
+            rest.remove_prefix(slash == std::string_view::npos ? rest.size() : slash + 1);
+            if (segment == "*")
+                levels[i] = Type::WILDCARD;
+            else if (segment[0] != '{')
+                levels[i] = Type::ABOSULUTE;
+            else
+                levels[i] = segment[1] == 'd'   ? Type::PARAM_INT
+                            : segment[1] == 'f' ? Type::PARAM_FLOAT
+                                                : Type::PARAM_STRING;
+        }
+        return levels;
+    }();
+
+    static constexpr size_t nParams = [] {
+        size_t count = 0;
+        for (Type type : levels)
+            count += type >= Type::PARAM_INT;
+        return count;
+    }();
+    static_assert(nParams <= MaxUrlParams, "Too many params in route");
+
+    // level index of each param
+    static constexpr std::array<size_t, nParams> paramLevels = [] {
+        std::array<size_t, nParams> indices{};
+        for (size_t i = 0, param = 0; i < nLevels; i++)
+            if (levels[i] >= Type::PARAM_INT) indices[param++] = i;
+        return indices;
+    }();
+
+    // the I-th param from its path segment, which the router already matched against its type.
+    // an int segment only matches when it fits
+    template <size_t I>
+    static auto param(const std::string_view& segment)
+    {
+        constexpr Type type = levels[paramLevels[I]];
+        if constexpr (type == Type::PARAM_INT) {
+            int64_t value = 0;
+            std::from_chars(segment.data(), segment.data() + segment.size(), value);
+            return value;
+        }
+        else if constexpr (type == Type::PARAM_FLOAT) {
+            double value = 0;
+            std::from_chars(segment.data(), segment.data() + segment.size(), value);
+            return value;
+        }
+        else
+            return segment;
+    }
+
+    template <size_t I>
+    using ParamType = decltype(param<I>(std::string_view()));
+
+    // slices the params out of a path the pattern matched, without copying anything
+    static void split(std::string_view absPath, std::string_view* segments)
+    {
+        absPath.remove_prefix(1);
+        for (size_t level = 0, param = 0; param < nParams; level++) {
+            size_t slash = absPath.find('/');
+            if (level == paramLevels[param]) segments[param++] = absPath.substr(0, slash);
+            absPath.remove_prefix(slash == std::string_view::npos ? absPath.size() : slash + 1);
+        }
+    }
+};
+
 }; // namespace cW
 
 #endif
\ No newline at end of file
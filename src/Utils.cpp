@@ -1,6 +1,16 @@
 #include "Utils.h"
+#include "Arena.h"
+#include <algorithm>
+#include <bit>
 #include <iostream>
 #include <fstream>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define CW_UNMASK_DISPATCH
+#endif
 
 namespace cW {
 
@@ -15,11 +25,203 @@ void Clock::printElapsed(const std::string& message, bool reset)
     if (reset) start();
 }
 
-char* url_decode(const char* str, size_t size)
+size_t find_bytes(const char* haystack, size_t size, const char* needle, size_t needleSize)
+{
+    if (needleSize == 0) return 0;
+    if (size < needleSize) return std::string_view::npos;
+    size_t i = 0;
+#ifdef __SSE2__
+    if (needleSize > 1) {
+        // compare first and last needle bytes 16 positions at a time, only verify where both hit
+        const __m128i first = _mm_set1_epi8(needle[0]);
+        const __m128i last  = _mm_set1_epi8(needle[needleSize - 1]);
+        for (; i + 16 + needleSize - 1 <= size; i += 16) {
+            __m128i  blockFirst = _mm_loadu_si128((const __m128i*)(haystack + i));
+            __m128i  blockLast  = _mm_loadu_si128((const __m128i*)(haystack + i + needleSize - 1));
+            unsigned mask       = _mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast)));
+            while (mask) {
+                unsigned bit = __builtin_ctz(mask);
+                if (std::memcmp(haystack + i + bit + 1, needle + 1, needleSize - 2) == 0)
+                    return i + bit;
+                mask &= mask - 1;
+            }
+        }
+    }
+#endif
+    const void* found = memmem(haystack + i, size - i, needle, needleSize);
+    return found ? (const char*)found - haystack : std::string_view::npos;
+}
+
+namespace {
+// the mask as it applies from `by` bytes further on
+inline uint32_t rotate_mask(uint32_t mask, size_t by)
+{
+    int bits = int(by % 4) * 8;
+    if constexpr (std::endian::native == std::endian::little)
+        return std::rotr(mask, bits);
+    else
+        return std::rotl(mask, bits);
+}
+
+inline void unmask_bytes(char* dest, const char* src, size_t size, uint32_t mask)
+{
+    const uint8_t* bytes = (const uint8_t*)&mask;
+    for (size_t i = 0; i < size; i++)
+        dest[i] = src[i] ^ bytes[i % 4];
+}
+
+void unmask_words(char* dest, const char* src, size_t size, uint32_t mask)
+{
+    uint64_t pattern = (uint64_t)mask << 32 | mask;
+    size_t   i       = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, src + i, 8);
+        word ^= pattern;
+        std::memcpy(dest + i, &word, 8);
+    }
+    unmask_bytes(dest + i, src + i, size - i, mask);
+}
+
+// long payloads first go up to an aligned dest so no store splits a cache line. short ones aren't
+// worth the scalar head
+inline size_t unmask_head(char* dest, const char* src, size_t size, uint32_t& mask, size_t align)
+{
+    if (size < 1024) return 0;
+    size_t head = -(uintptr_t)dest & (align - 1);
+    unmask_words(dest, src, head, mask);
+    mask = rotate_mask(mask, head);
+    return head;
+}
+
+#ifdef __SSE2__
+void unmask_sse2(char* dest, const char* src, size_t size, uint32_t mask)
+{
+    size_t        i       = unmask_head(dest, src, size, mask, 16);
+    const __m128i pattern = _mm_set1_epi32((int)mask);
+    for (; i + 16 <= size; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dest + i), _mm_xor_si128(block, pattern));
+    }
+    unmask_words(dest + i, src + i, size - i, mask);
+}
+#endif
+
+#ifdef CW_UNMASK_DISPATCH
+__attribute__((target("avx2"))) void unmask_avx2(char* dest, const char* src, size_t size,
+                                                 uint32_t mask)
+{
+    size_t        i       = unmask_head(dest, src, size, mask, 32);
+    const __m256i pattern = _mm256_set1_epi32((int)mask);
+    for (; i + 64 <= size; i += 64) {
+        __m256i first  = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i second = _mm256_loadu_si256((const __m256i*)(src + i + 32));
+        _mm256_storeu_si256((__m256i*)(dest + i), _mm256_xor_si256(first, pattern));
+        _mm256_storeu_si256((__m256i*)(dest + i + 32), _mm256_xor_si256(second, pattern));
+    }
+    if (i + 32 <= size) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(dest + i), _mm256_xor_si256(block, pattern));
+        i += 32;
+    }
+    unmask_words(dest + i, src + i, size - i, mask);
+}
+
+// the tail is one masked load and store instead of a scalar loop
+__attribute__((target("avx512f,avx512bw"))) void unmask_avx512(char* dest, const char* src,
+                                                               size_t size, uint32_t mask)
+{
+    size_t        i       = unmask_head(dest, src, size, mask, 64);
+    const __m512i pattern = _mm512_set1_epi32((int)mask);
+    for (; i + 64 <= size; i += 64) {
+        __m512i block = _mm512_loadu_si512(src + i);
+        _mm512_storeu_si512(dest + i, _mm512_xor_si512(block, pattern));
+    }
+    if (i < size) {
+        __mmask64 tail  = ~0ULL >> (64 - (size - i));
+        __m512i   block = _mm512_maskz_loadu_epi8(tail, src + i);
+        _mm512_mask_storeu_epi8(dest + i, tail, _mm512_xor_si512(block, pattern));
+    }
+}
+#endif
+
+struct UnmaskKernel {
+    void (*run)(char*, const char*, size_t, uint32_t);
+    const char* name;
+};
+
+UnmaskKernel pick_unmask_kernel()
+{
+#ifdef CW_UNMASK_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return {unmask_avx512, "avx512"};
+    if (__builtin_cpu_supports("avx2")) return {unmask_avx2, "avx2"};
+#endif
+#ifdef __SSE2__
+    return {unmask_sse2, "sse2"};
+#else
+    return {unmask_words, "words"};
+#endif
+}
+
+const UnmaskKernel unmask_kernel = pick_unmask_kernel();
+} // namespace
+
+void ws_unmask(char* dest, const char* src, size_t size, const uint8_t (&mask)[4], size_t offset)
+{
+    uint32_t word;
+    std::memcpy(&word, mask, 4);
+    word = rotate_mask(word, offset);
+    // a couple of words aren't worth the indirect call
+    if (size <= 16)
+        unmask_words(dest, src, size, word);
+    else
+        unmask_kernel.run(dest, src, size, word);
+}
+
+const char* ws_unmask_kernel() { return unmask_kernel.name; }
+
+bool valid_utf8(const char* data, size_t size)
+{
+    const uint8_t* pos = (const uint8_t*)data;
+    const uint8_t* end = pos + size;
+    while (pos < end) {
+        uint8_t lead = *pos++;
+        if (lead < 0x80) continue;
+        // allowed range of the second byte narrows for the leads that could go overlong or out
+        // of range, the rest are plain continuations
+        size_t  more;
+        uint8_t low = 0x80, high = 0xbf;
+        if (lead >= 0xc2 && lead <= 0xdf)
+            more = 1;
+        else if (lead >= 0xe0 && lead <= 0xef) {
+            more = 2;
+            if (lead == 0xe0) low = 0xa0;
+            if (lead == 0xed) high = 0x9f;
+        }
+        else if (lead >= 0xf0 && lead <= 0xf4) {
+            more = 3;
+            if (lead == 0xf0) low = 0x90;
+            if (lead == 0xf4) high = 0x8f;
+        }
+        else
+            return false;
+        if ((size_t)(end - pos) < more || *pos < low || *pos > high) return false;
+        for (pos++; --more; pos++)
+            if ((*pos & 0xc0) != 0x80) return false;
+    }
+    return true;
+}
+
+static size_t url_decoded_length(const char* str, size_t size)
+{
+    return size - count_char('%', str, size) * 2 + 1;
+}
+
+static void url_decode_into(char* dest, size_t dest_len, const char* str, size_t size)
 {
-    if (size == 0) size = strlen(str);
-    size_t dest_len = size - count_char('%', str, size) * 2 + 1;
-    char*  dest     = (char*)malloc(dest_len);
     size_t i, j;
     for (i = j = 0; j < dest_len - 1 && i < size; i++, j++) {
         if (str[i] == '%') {
@@ -35,6 +237,23 @@ char* url_decode(const char* str, size_t size)
     }
     assert((j == dest_len - 1) && "Invalid url encoded string");
     dest[j] = '\0';
+}
+
+char* url_decode(const char* str, size_t size)
+{
+    if (size == 0) size = strlen(str);
+    size_t dest_len = url_decoded_length(str, size);
+    char*  dest     = (char*)malloc(dest_len);
+    url_decode_into(dest, dest_len, str, size);
+    return dest;
+}
+
+char* url_decode(Arena& arena, const char* str, size_t size)
+{
+    if (size == 0) size = strlen(str);
+    size_t dest_len = url_decoded_length(str, size);
+    char*  dest     = (char*)arena.alloc(dest_len, 1);
+    url_decode_into(dest, dest_len, str, size);
     return dest;
 }
 
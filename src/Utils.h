@@ -12,6 +12,8 @@
 #include <vector>
 namespace cW {
 
+class Arena;
+
 #define __INF__ static_cast<size_t>(-1)
 
 template <typename T>
@@ -166,7 +168,22 @@ inline size_t ci_find(const std::string_view& str, const char* pattern)
     return ci_find<rightLowerCase>(str.data(), str.size(), pattern, strlen(pattern));
 }
 
+// offset of needle in haystack or npos, candidates are prefiltered with SSE2 when available
+size_t find_bytes(const char* haystack, size_t size, const char* needle, size_t needleSize);
+
+// xors src with the repeating websocket mask into dest, which may be src itself. offset is how far
+// into the payload src starts, for frames that arrive in pieces. picks the widest of AVX-512, AVX2
+// and SSE2 the cpu has, falling back to 64 bit words
+void ws_unmask(char* dest, const char* src, size_t size, const uint8_t (&mask)[4],
+               size_t offset = 0);
+// name of the kernel ws_unmask runs on this cpu
+const char* ws_unmask_kernel();
+// strict utf-8, overlong forms, surrogates and code points past U+10FFFF are rejected
+bool valid_utf8(const char* data, size_t size);
+
 char* url_decode(const char* str, size_t size = 0);
+// same as above but the decoded string lives in the arena
+char* url_decode(Arena& arena, const char* str, size_t size = 0);
 
 // returns string of zeros and ones as binary data
 template <typename T>
@@ -1,20 +1,47 @@
 #include "WebSocket.h"
+#include "FrameBuffer.h"
+#include "WebSocketSession.h"
 
 namespace cW {
 
-WsMessage::WsMessage(WsOpcode opcode, const char* payload, size_t payloadSize)
-    : opcode(opcode), payload(payload), payloadSize(payloadSize)
+WsMessage::WsMessage(WsOpcode opcode, const char* payload, size_t payloadSize, bool final)
+    : opcode(opcode), payload(payload), payloadSize(payloadSize), final(final)
 {
 }
 
-WebSocket::WebSocket(HttpRequest* request) : httpRequest(request) {}
+WebSocket::WebSocket(WebSocketSession* session, HttpRequest* request)
+    : session(session), httpRequest(request)
+{
+}
+
+bool WebSocket::sendMessage(WsOpcode opcode, const char* data, size_t size)
+{
+    if (!size) size = strlen(data);
+    return session->send(opcode, std::string_view(data, size));
+}
+
+bool WebSocket::sendMessage(WsOpcode opcode, const std::string_view& data)
+{
+    return session->send(opcode, data);
+}
+
+bool WebSocket::sendMessage(const WsSharedMessage& message) { return session->send(message.frame); }
+
+bool WebSocket::sendMessage(WsOpcode                          opcode,
+                            size_t                            size,
+                            const std::function<void(char*)>& write)
+{
+    return session->send(opcode, size, write);
+}
+
+size_t WebSocket::bufferedAmount() const { return session->bufferedAmount(); }
+
+bool WebSocket::subscribe(const std::string_view& topic) { return session->subscribe(topic); }
+bool WebSocket::unsubscribe(const std::string_view& topic) { return session->unsubscribe(topic); }
+
 WebSocket::~WebSocket()
 {
-    delete httpRequest;
-    while (!queuedMessages.empty()) {
-        delete queuedMessages.front();
-        queuedMessages.pop();
-    }
+    Arena::destroy(httpRequest);
 }
 
 }; // namespace cW
\ No newline at end of file
@@ -1,11 +1,15 @@
 #ifndef __CW_WEB_SOCKET_H_
 #define __CW_WEB_SOCKET_H_
 
-#include <queue>
+#include <functional>
 #include "HttpRequest.h"
+#include "WebSocketOpts.h"
 namespace cW {
 
-enum WsEvent { OPEN, MESSAGE, PING, PONG, CLOSE, UPGRADE };
+class WebSocketSession;
+class WsSharedMessage;
+
+enum WsEvent { OPEN, MESSAGE, PING, PONG, CLOSE, UPGRADE, DRAIN, STREAM };
 
 enum WsOpcode { Continuation = 0, Text = 1, Binary = 2, Close = 8, Ping = 9, Pong = 10 };
 
@@ -15,13 +19,16 @@ struct WsMessage {
 
     const WsOpcode opcode;
 
-    inline std::string_view data() { return std::string_view(payload, payloadSize); }
+    inline std::string_view data() const { return std::string_view(payload, payloadSize); }
+    // a streamed message continues in the next piece unless this is its last
+    inline bool last() const { return final; }
 
   private:
     // doesn't own payload
-    WsMessage(WsOpcode opcode, const char* payload, size_t payloadSize);
+    WsMessage(WsOpcode opcode, const char* payload, size_t payloadSize, bool final = true);
     const char* payload;
     size_t      payloadSize;
+    bool        final;
 };
 
 // the request+response of websocket
@@ -29,14 +36,14 @@ class WebSocket {
     friend class WebSocketSession;
     friend class Router;
 
-    HttpRequest* httpRequest;
-
-    WsMessage* currentMessage;
+    WebSocketSession* session;
+    HttpRequest*      httpRequest;
+    // of the route that opened it
+    const WebSocketOpts* opts = nullptr;
 
-    // outgoing message queue
-    std::queue<WsMessage*> queuedMessages;
+    WsMessage* currentMessage = nullptr;
 
-    WebSocket(HttpRequest* request);
+    WebSocket(WebSocketSession* session, HttpRequest* request);
 
   public:
     template <typename T>
@@ -60,17 +67,26 @@ class WebSocket {
         return httpRequest->getQuery<T>(key);
     }
     inline const WsMessage& getMessage();
-    inline void             sendMessage(WsOpcode opcode, const char* data, size_t size = 0);
+    // framed on the spot, data is free to go once it returns. false once MaxBackpressure is
+    // reached: the message was dropped, the connection is closing, or under
+    // WsBackpressure::PAUSE it was queued and the sender should wait for drain
+    bool sendMessage(WsOpcode opcode, const char* data, size_t size = 0);
+    bool sendMessage(WsOpcode opcode, const std::string_view& data);
+    // queues the shared frame itself, unless this connection compresses or splits the message
+    bool sendMessage(const WsSharedMessage& message);
+    // write fills the size bytes of payload right behind the frame header
+    bool sendMessage(WsOpcode opcode, size_t size, const std::function<void(char*)>& write);
+    // bytes sent that the kernel hasn't taken yet
+    size_t bufferedAmount() const;
+    // Server::publish to the topic reaches this websocket until it unsubscribes or closes. false
+    // if it already was / wasn't subscribed
+    bool subscribe(const std::string_view& topic);
+    bool unsubscribe(const std::string_view& topic);
 
     ~WebSocket();
 };
 
 const WsMessage& WebSocket::getMessage() { return *currentMessage; }
-void             WebSocket::sendMessage(WsOpcode opcode, const char* data, size_t size)
-{
-    if (!size) size = strlen(data);
-    queuedMessages.push(new WsMessage(opcode, data, size));
-}
 
 }; // namespace cW
 
@@ -0,0 +1,67 @@
+#ifndef __CW_WEB_SOCKET_OPTS_H_
+#define __CW_WEB_SOCKET_OPTS_H_
+
+#include <cstddef>
+
+namespace cW {
+
+// permessage-deflate (RFC 7692), only used when the client offers it
+enum class WsCompression {
+    DISABLED,
+    // one compressor per loop, reset after every message. connections hold no compression state
+    // and a message compresses to the same bytes for every receiver, which is what broadcasts want
+    SHARED,
+    // every connection keeps its own sliding window across messages. best ratio on repetitive
+    // streams at 2^CompressionWindowBits bytes plus hash tables per connection
+    DEDICATED
+};
+
+// what happens to a connection with MaxBackpressure bytes waiting to be written
+enum class WsBackpressure {
+    // messages sent or published to it are dropped until it catches up
+    DROP,
+    // it is closed with 1008, what it hasn't started receiving is discarded
+    CLOSE,
+    // sendMessage still queues and returns false, the sender waits for the drain event.
+    // publications are dropped, one slow subscriber can't hold up a topic
+    PAUSE
+};
+
+// per route options, given to open()
+struct WebSocketOpts {
+    // larger incoming messages close the connection with 1009, also the outgoing frame size
+    size_t MaxPayloadLength = 1024 * 1024;
+    // takes MaxPayloadLength's place on routes that stream messages, which buffer none of them.
+    // checked against each frame header before any of its payload is handed over, 0 for no limit
+    size_t MaxMessageLength = 0;
+
+    WsCompression Compression = WsCompression::DISABLED;
+    // 9 to 15, the window kept by dedicated compressors and asked of clients that allow it
+    int CompressionWindowBits = 15;
+    // zlib level
+    int CompressionLevel = 6;
+    // smaller messages are sent as they are
+    size_t MinCompressLength = 64;
+    // asks clients to reset their compressor after every message, so inflating needs no window
+    // kept per connection either
+    bool ClientNoContextTakeover = false;
+
+    // bytes a connection may have queued before Backpressure applies, 0 for no limit. one message
+    // can go past it. drain is dispatched once it is back under half
+    size_t         MaxBackpressure = 16 * 1024 * 1024;
+    WsBackpressure Backpressure    = WsBackpressure::DROP;
+
+    // seconds the peer can be quiet before it is pinged, 0 for never. heartbeats are checked on
+    // a one second tick, a quiet peer is pinged within twice this
+    unsigned PingInterval = 30;
+    // seconds a ping or close frame has to be answered in, by anything, before the peer is taken
+    // for dead and the connection dropped
+    unsigned PongTimeout = 10;
+    // seconds without a message from the peer before it is closed with 1001, 0 for never. control
+    // frames don't count
+    unsigned IdleTimeout = 0;
+};
+
+}; // namespace cW
+
+#endif
@@ -1,208 +1,600 @@
 #include "WebSocketSession.h"
 #include "ClientSocket.h"
+#include "Poll.h"
 #include "Server.h"
+#include "Sha1.h"
+#include "base64.h"
 namespace cW {
 
-WebSocketSession::WebSocketSession(ClientSocket* socket) : Session(socket, Session::WS)
+WebSocketSession::WebSocketSession(ClientSocket* socket, const std::string_view& requestHeader)
+    : Session(socket, Session::WS)
 {
-    // TODO:Implemet
-    // size_t headerEnd = socket->receiveBuffer.find("\r\n\r\n");
-    // requestHeader    = socket->receiveBuffer.substr(headerEnd + 2);
-    // webSocket        = new WebSocket(new HttpRequest(requestHeader));
+    // the request is read for as long as the connection lives, so its header can't stay in the
+    // receive buffer like it does for http. everything goes in the connection arena
+    Arena&       arena   = socket->arena;
+    HttpRequest* request = new (arena.alloc(sizeof(HttpRequest), alignof(HttpRequest)))
+        HttpRequest(arena, arena.copy(requestHeader));
+    webSocket =
+        new (arena.alloc(sizeof(WebSocket), alignof(WebSocket))) WebSocket(this, request);
+    handshake();
+    // the handshake split the headers, the queries go in now so no lookup grows the request later
+    request->splitQueries();
+    messageMark = arena.mark();
 }
 
-//[shouldCancel, complete]
-std::pair<bool, bool> WebSocketSession::parseFrame(const std::string_view& recvBuf)
+void WebSocketSession::handshake()
 {
-    WsFrame*     frame;
-    bool         first;
-    unsigned int headerLength = 0;
-    const char*  data         = recvBuf.data();
-    size_t       bufLen       = recvBuf.size();
-    if (first = !currentFrame) {
-        if (recvBuf.size() < 2) return {false, false};
+    static const std::string_view badRequest = "HTTP/1.1 400 Bad Request\r\n"
+                                               "Connection: close\r\nContent-Length: 0\r\n\r\n";
+    static const std::string_view badVersion = "HTTP/1.1 426 Upgrade Required\r\n"
+                                               "Sec-WebSocket-Version: 13\r\n"
+                                               "Connection: close\r\nContent-Length: 0\r\n\r\n";
+    static const std::string_view notFound   = "HTTP/1.1 404 Not Found\r\n"
+                                               "Connection: close\r\nContent-Length: 0\r\n\r\n";
+    static const std::string_view switching  = "HTTP/1.1 101 Switching Protocols\r\n"
+                                               "Upgrade: websocket\r\n"
+                                               "Connection: Upgrade\r\n"
+                                               "Sec-WebSocket-Accept: ";
+    static const std::string_view guid       = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
 
-        // creating new frame
-        frame             = (WsFrame*)malloc(sizeof(WsFrame));
-        frame->readOffset = 0;
+    HttpRequest*     request = webSocket->httpRequest;
+    std::string_view key, version, connection;
+    // the key is 16 random bytes in base64
+    if (request->method != HttpMethod::GET || !request->findHeader("connection", connection) ||
+        ci_find(connection, "upgrade") == __INF__ ||
+        !request->findHeader("sec-websocket-key", key) || key.size() != 24)
+        return refuse(badRequest);
+    if (!request->findHeader("sec-websocket-version", version) || version != "13")
+        return refuse(badVersion);
+    // whatever the open handler sends is only queued, so it still goes out after the 101
+    if (!socket->server->dispatch(WsEvent::OPEN, webSocket)) return refuse(notFound);
+    streaming = socket->server->handles(WsEvent::STREAM, webSocket);
+    std::string_view extensions;
+    if (request->findHeader("sec-websocket-extensions", extensions))
+        compression = negotiateDeflate(extensions, *opts(), deflateParams);
 
-        static_assert(sizeof(WsFrame::header) == 2, "Frame header size is larger than two bytes");
-
-        std::memcpy(&(frame->header), data, 2);
+    uint8_t digest[Sha1::DigestLength];
+    Sha1().update(key).update(guid).finish(digest);
+    char   response[192 + MaxDeflateResponse];
+    size_t length = switching.size();
+    std::memcpy(response, switching.data(), length);
+    length += base64::base64_encode(digest, sizeof(digest), response + length);
+    if (compression) {
+        std::memcpy(response + length, "\r\nSec-WebSocket-Extensions: ", 28);
+        length += 28;
+        length += formatDeflate(deflateParams, response + length);
+    }
+    std::memcpy(response + length, "\r\n\r\n", 4);
+    socket->write(response, length + 4, true, true);
+    lastMessage = socket->poll->timers.tick();
+    schedule();
+}
 
-        if (!frame->header.mask) return {true, false};
+void WebSocketSession::refuse(const std::string_view& response)
+{
+    socket->write(response, true);
+    socket->connected = false;
+    closing           = true;
+}
 
-        headerLength = 2;
-        if (frame->header.payloadLenShort == 126) {
-            headerLength += 2;
-            uint16_t length;
-            std::memcpy(&length, data + 2, 2);
-            reverseByteOrder(&length);
-            frame->payloadLength = (uint64_t)length;
-        }
-        else if (frame->header.payloadLenShort == 127) {
-            headerLength += 8;
-            uint64_t length;
-            std::memcpy(&length, data + 2, 8);
-            reverseByteOrder(&length);
-            frame->payloadLength = (uint64_t)length;
+bool WebSocketSession::readHeader(char*& data, const char* end)
+{
+    size_t buffered  = headerBuffered;
+    size_t available = buffered + (end - data);
+    auto   byte      = [&](size_t i) -> uint8_t {
+        return i < buffered ? headerBuffer[i] : (uint8_t)data[i - buffered];
+    };
+    // clients always mask, so the 4 byte key follows the length
+    size_t length = 6;
+    if (available >= 2) {
+        if (!(byte(1) & 0x80)) {
+            fail(WsClose::ProtocolError);
+            return false;
         }
-        else
-            frame->payloadLength = (uint64_t)frame->header.payloadLenShort;
+        if ((byte(1) & 0x7f) >= 126) length += (byte(1) & 0x7f) == 126 ? 2 : 8;
+    }
+    if (available < length) {
+        std::memcpy(headerBuffer + buffered, data, end - data);
+        headerBuffered = (uint8_t)available;
+        data           = (char*)end;
+        return true;
+    }
+
+    uint8_t first = byte(0), second = byte(1);
+    frame.fin           = first & 0x80;
+    frame.opcode        = (WsOpcode)(first & 0x0f);
+    frame.payloadLength = second & 0x7f;
+    frame.readOffset    = 0;
+    size_t i            = 2;
+    if (frame.payloadLength >= 126) {
+        size_t extendedEnd  = frame.payloadLength == 126 ? 4 : 10;
+        frame.payloadLength = 0;
+        for (; i < extendedEnd; i++)
+            frame.payloadLength = frame.payloadLength << 8 | byte(i);
+    }
+    for (size_t j = 0; j < 4; j++)
+        frame.mask[j] = byte(i + j);
+    data += length - buffered;
+    headerBuffered = 0;
 
-        std::memcpy(&(frame->mask[0]), data + headerLength, 4);
-        // including mask
-        headerLength += 4;
-        currentFrame = frame;
-        framePending = frame->header.fin != 1;
-        payloadBuffer.reserve(frame->payloadLength);
+    bool valid;
+    switch (frame.opcode) {
+        case WsOpcode::Continuation: valid = fragmentPending; break;
+        case WsOpcode::Text:
+        case WsOpcode::Binary: valid = !fragmentPending; break;
+        // control frames can't be fragmented
+        case WsOpcode::Close:
+        case WsOpcode::Ping:
+        case WsOpcode::Pong: valid = frame.fin && frame.payloadLength <= 125; break;
+        default: valid = false;
+    }
+    // rsv1 marks the first frame of a compressed message, nothing uses the other two
+    bool compressed = first & 0x40;
+    bool starts     = frame.opcode == WsOpcode::Text || frame.opcode == WsOpcode::Binary;
+    if (!valid || (first & 0x30) || (compressed && (!compression || !starts))) {
+        fail(WsClose::ProtocolError);
+        return false;
     }
+    if (starts) {
+        messageOpcode     = frame.opcode;
+        messageCompressed = compressed;
+        streamed          = 0;
+    }
+    // told from the header, before anything of the frame is buffered or handed over
+    bool tooBig;
+    if (streaming)
+        tooBig = opts()->MaxMessageLength &&
+                 frame.payloadLength > opts()->MaxMessageLength - streamed;
     else
-        frame = currentFrame;
+        tooBig = frame.payloadLength > opts()->MaxPayloadLength - payloadBuffer.size();
+    if (frame.opcode < WsOpcode::Close && tooBig) {
+        fail(WsClose::TooBig);
+        return false;
+    }
+    inFrame = true;
+    return true;
+}
+
+void WebSocketSession::readPayload(char*& data, const char* end)
+{
+    size_t available = std::min(frame.payloadLength - frame.readOffset, (size_t)(end - data));
+    bool   control   = frame.opcode >= WsOpcode::Close;
+    // unmasked where it lies and handed over right away, an empty piece still ends a message
+    if (streaming && !control) {
+        unMask(data, data, available, frame.mask, frame.readOffset);
+        frame.readOffset += available;
+        data += available;
+        bool done = frame.readOffset == frame.payloadLength;
+        if (done) {
+            inFrame         = false;
+            fragmentPending = !frame.fin;
+        }
+        if (available || (done && frame.fin))
+            stream(std::string_view(data - available, available), done && frame.fin);
+        return;
+    }
+    // a whole message in this read is handed over straight from the receive buffer
+    if (frame.readOffset == 0 && available == frame.payloadLength &&
+        (control || (frame.fin && !fragmentPending))) {
+        unMask(data, data, available, frame.mask, 0);
+        inFrame = false;
+        data += available;
+        deliver(frame.opcode, std::string_view(data - available, available));
+        return;
+    }
+
+    char* dest;
+    if (control)
+        dest = controlBuffer + frame.readOffset;
+    else {
+        size_t start = payloadBuffer.size();
+        payloadBuffer.resize(start + available);
+        dest = payloadBuffer.data() + start;
+    }
+    unMask(dest, data, available, frame.mask, frame.readOffset);
+    frame.readOffset += available;
+    data += available;
+    if (frame.readOffset < frame.payloadLength) return;
+
+    inFrame = false;
+    if (control)
+        deliver(frame.opcode, std::string_view(controlBuffer, frame.payloadLength));
+    else if (!frame.fin)
+        fragmentPending = true;
+    else {
+        deliver(messageOpcode, payloadBuffer);
+        payloadBuffer.clear();
+        fragmentPending = false;
+    }
+}
+
+void WebSocketSession::deliver(WsOpcode opcode, const std::string_view& payload)
+{
+    static thread_local std::string inflated;
+    WsMessage                       message(opcode, payload.data(), payload.size());
+    if (opcode < WsOpcode::Close && messageCompressed) {
+        inflated.clear();
+        try {
+            if (!decompressor()->inflate(payload, inflated, opts()->MaxPayloadLength))
+                return fail(WsClose::TooBig);
+        }
+        catch (std::runtime_error&) {
+            return fail(WsClose::InvalidData);
+        }
+        message.payload     = inflated.data();
+        message.payloadSize = inflated.size();
+    }
+    // text has to be utf-8 as a whole, a streamed one is the handler's to check
+    if (opcode == WsOpcode::Text && !valid_utf8(message.payload, message.payloadSize))
+        return fail(WsClose::InvalidData);
+    webSocket->currentMessage = &message;
+    switch (opcode) {
+        case WsOpcode::Text:
+        case WsOpcode::Binary:
+            lastMessage = socket->poll->timers.tick();
+            socket->server->dispatch(WsEvent::MESSAGE, webSocket);
+            break;
+        case WsOpcode::Close:
+            if (!validClose(payload)) {
+                fail(WsClose::ProtocolError);
+                break;
+            }
+            // echo the status code, the socket closes once that is written
+            formatFrames(payload.data(), std::min(payload.size(), (size_t)2), WsOpcode::Close);
+            closing = true;
+            socket->server->dispatch(WsEvent::CLOSE, webSocket);
+            break;
+        case WsOpcode::Ping:
+            formatFrames(payload.data(), payload.size(), WsOpcode::Pong);
+            socket->server->dispatch(WsEvent::PING, webSocket);
+            break;
+        case WsOpcode::Pong: socket->server->dispatch(WsEvent::PONG, webSocket); break;
+        default: break;
+    }
+    webSocket->currentMessage = nullptr;
+    socket->arena.rewind(messageMark);
+}
 
-    if (recvBuf.size() > headerLength) {
-        size_t toAdd = std::min(bufLen - headerLength, frame->payloadLength);
-        payloadBuffer.append(data + headerLength, toAdd);
-        frame->readOffset += toAdd;
+void WebSocketSession::stream(const std::string_view& data, bool last)
+{
+    static thread_local std::string inflated;
+    if (!messageCompressed) {
+        deliverPiece(data, last);
+        return;
     }
-    if (frame->readOffset >= frame->payloadLength) {
-        unMask((uint8_t*)(char*)payloadBuffer.data(), frame->payloadLength, frame->mask);
-        return {false, true};
+    // a bomb comes out a piece at a time like anything else, MaxMessageLength stops it
+    static const size_t piece = 64 * 1024;
+    try {
+        if (!decompressor()->inflate(data, last, inflated, piece, [this](auto& full) {
+                return deliverPiece(full, false);
+            }))
+            return;
     }
-    return {false, false};
+    catch (std::runtime_error&) {
+        return fail(WsClose::InvalidData);
+    }
+    if (!inflated.empty() || last) deliverPiece(inflated, last);
+}
+
+bool WebSocketSession::deliverPiece(const std::string_view& piece, bool last)
+{
+    streamed += piece.size();
+    if (opts()->MaxMessageLength && streamed > opts()->MaxMessageLength) {
+        fail(WsClose::TooBig);
+        return false;
+    }
+    WsMessage message(messageOpcode, piece.data(), piece.size(), last);
+    lastMessage               = socket->poll->timers.tick();
+    webSocket->currentMessage = &message;
+    socket->server->dispatch(WsEvent::STREAM, webSocket);
+    webSocket->currentMessage = nullptr;
+    socket->arena.rewind(messageMark);
+    return !closing;
+}
+
+bool WebSocketSession::validClose(const std::string_view& payload)
+{
+    if (payload.empty()) return true;
+    if (payload.size() < 2) return false;
+    uint16_t code = (uint8_t)payload[0] << 8 | (uint8_t)payload[1];
+    // 1004 is reserved, 1005, 1006 and 1015 only ever stand in for a code that wasn't sent.
+    // 3000-4999 belong to libraries and applications
+    bool sendable = (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1014) ||
+                    (code >= 3000 && code <= 4999);
+    return sendable && valid_utf8(payload.data() + 2, payload.size() - 2);
+}
+
+void WebSocketSession::fail(WsClose code)
+{
+    char payload[2] = {char(code >> 8), char(code & 0xff)};
+    formatFrames(payload, 2, WsOpcode::Close);
+    closing = true;
+}
+
+WsDeflater* WebSocketSession::compressor()
+{
+    if (deflateParams.serverNoContextTakeover)
+        return WsDeflater::shared(opts()->CompressionLevel, deflateParams.serverMaxWindowBits);
+    if (!deflater)
+        deflater =
+            new WsDeflater(opts()->CompressionLevel, deflateParams.serverMaxWindowBits, true);
+    return deflater;
+}
+
+WsInflater* WebSocketSession::decompressor()
+{
+    // a streamed message stays in its inflater between reads, other connections can't share it
+    if (deflateParams.clientNoContextTakeover && !streaming) return WsInflater::shared();
+    if (!inflater)
+        inflater = new WsInflater(deflateParams.clientMaxWindowBits,
+                                  !deflateParams.clientNoContextTakeover);
+    return inflater;
 }
 
 // format frames and add them to the queue
-void WebSocketSession::formatFrames(const char* payload, size_t payloadLength, WsOpcode opcode)
+void WebSocketSession::formatFrames(const char* payload,
+                                    size_t      payloadLength,
+                                    WsOpcode    opcode,
+                                    bool        compressed)
+{
+    // longer than MaxPayloadLength goes out as continuations
+    do {
+        size_t framePayloadSize = std::min(payloadLength, opts()->MaxPayloadLength);
+        bool   last             = framePayloadSize == payloadLength;
+        queueFrame(FrameBuffer::format(opcode, payload, framePayloadSize, last, compressed));
+
+        payload += framePayloadSize;
+        payloadLength -= framePayloadSize;
+        opcode     = WsOpcode::Continuation;
+        compressed = false;
+    } while (payloadLength);
+}
+
+void WebSocketSession::queueFrame(FrameBuffer* frame)
 {
+    queuedFrames.push_back(frame);
+    buffered += frame->size;
     socket->wantWrite = true;
-    WsFrameHeader header;
-    size_t        framePayloadSize;
-    bool          last;
-    if (last = header.fin = (payloadLength <= opts.MaxPayloadLength))
-        framePayloadSize = payloadLength;
+}
+
+bool WebSocketSession::reframes(WsOpcode opcode, size_t size) const
+{
+    return size > opts()->MaxPayloadLength ||
+           (compression && opcode < WsOpcode::Close && size >= opts()->MinCompressLength);
+}
+
+void WebSocketSession::formatMessage(WsOpcode opcode, const std::string_view& payload)
+{
+    static thread_local std::string compressed;
+    if (compression && opcode < WsOpcode::Close && payload.size() >= opts()->MinCompressLength) {
+        compressed.clear();
+        compressor()->compress(payload, compressed);
+        formatFrames(compressed.data(), compressed.size(), opcode, true);
+    }
     else
-        framePayloadSize = opts.MaxPayloadLength;
-    // server doesn't mask
-    header.mask = false;
-    // no meaning for these yet
-    header.rsv1 = header.rsv2 = header.rsv3 = false;
-    // opcode enum values are set accordingly
-    header.opcode = (uint8_t)opcode;
-
-    Frame* frame          = (Frame*)malloc(sizeof(Frame));
-    frame->opcode         = opcode;
-    size_t   headerLength = 2;
-    void*    extendedLen;
-    uint16_t extendedLenSize = 0;
-    if (payloadLength <= 125) { header.payloadLenShort = (uint8_t)payloadLength; }
-    else if (payloadLength <= UINT16_MAX) {
-        header.payloadLenShort = (uint8_t)126;
-        headerLength += 2;
-        uint16_t* exlen = (uint16_t*)malloc(extendedLenSize = 2);
-        *exlen          = (uint16_t)payloadLength;
-        reverseByteOrder(exlen);
-        extendedLen = exlen;
+        formatFrames(payload.data(), payload.size(), opcode);
+}
+
+bool WebSocketSession::send(WsOpcode opcode, const std::string_view& payload)
+{
+    if (!admit(false)) return false;
+    formatMessage(opcode, payload);
+    return !overLimit();
+}
+
+bool WebSocketSession::send(FrameBuffer* frame)
+{
+    if (!admit(false)) return false;
+    if (reframes(frame->opcode, frame->payload().size()))
+        formatMessage(frame->opcode, frame->payload());
+    else
+        queueFrame(frame->retain());
+    return !overLimit();
+}
+
+bool WebSocketSession::send(WsOpcode opcode, size_t size, const std::function<void(char*)>& write)
+{
+    static thread_local std::string payload;
+    if (!admit(false)) return false;
+    // compressing or splitting it takes the whole payload first
+    if (reframes(opcode, size)) {
+        payload.resize(size);
+        write(payload.data());
+        formatMessage(opcode, payload);
     }
     else {
-        header.payloadLenShort = (uint8_t)127;
-        headerLength += 8;
-        uint64_t* exlen = (uint64_t*)malloc(extendedLenSize = 8);
-        *exlen          = (uint64_t)payloadLength;
-        reverseByteOrder(exlen);
-        extendedLen = exlen;
+        FrameBuffer* frame = FrameBuffer::allocate(opcode, size);
+        write(frame->data() + frame->size - size);
+        queueFrame(frame);
+    }
+    return !overLimit();
+}
+
+size_t WebSocketSession::bufferedAmount() const
+{
+    return buffered + socket->writeBuffer.size();
+}
+
+bool WebSocketSession::overLimit()
+{
+    size_t limit = opts()->MaxBackpressure;
+    bool   over  = limit && bufferedAmount() >= limit;
+    congested |= over;
+    return over;
+}
+
+bool WebSocketSession::admit(bool published)
+{
+    if (closing) return false;
+    if (!overLimit()) return true;
+    // publications go out once their whole batch is queued, what the socket takes now is no
+    // backlog
+    if (published) {
+        writeFrames();
+        if (!overLimit()) return true;
+    }
+    switch (opts()->Backpressure) {
+        case WsBackpressure::CLOSE: shed(); return false;
+        case WsBackpressure::PAUSE: return !published;
+        default: return false;
     }
-    frame->size = headerLength + framePayloadSize;
-    frame->data = (char*)malloc(frame->size);
+}
 
-    std::memcpy(frame->data, &header, 2);
-    if (extendedLenSize) {
-        std::memcpy(frame->data + 2, extendedLen, extendedLenSize);
-        free(extendedLen);
+void WebSocketSession::shed()
+{
+    // a frame partly written has to be finished, the close frame can't go in the middle of it
+    size_t kept = frontFrame + (writeOffset ? 1 : 0);
+    for (size_t i = kept; i < queuedFrames.size(); i++)
+        queuedFrames[i]->release();
+    queuedFrames.resize(kept);
+    buffered = writeOffset ? queuedFrames[frontFrame]->size - writeOffset : 0;
+    fail(WsClose::Policy);
+}
+
+void WebSocketSession::writeFrames()
+{
+    while (frontFrame < queuedFrames.size()) {
+        size_t front = frontFrame, offset = writeOffset;
+        onWritable();
+        if (frontFrame == front && writeOffset == offset) break;
     }
-    std::memcpy(frame->data + headerLength, &header, framePayloadSize);
+}
 
-    queuedFrames.push(frame);
-    if (!last)
-        formatFrames(
-            payload + framePayloadSize, payloadLength - framePayloadSize, WsOpcode::Continuation);
+bool WebSocketSession::subscribe(const std::string_view& topic)
+{
+    return socket->poll->pubsub.subscribe(this, topic);
 }
 
-void WebSocketSession::cleanUp() { delete webSocket; }
+bool WebSocketSession::unsubscribe(const std::string_view& topic)
+{
+    return socket->poll->pubsub.unsubscribe(this, topic);
+}
 
-WebSocketSession::~WebSocketSession()
+void WebSocketSession::heartbeat()
 {
-    delete webSocket;
-    freeWsFrame(currentFrame);
-    while (!queuedFrames.empty()) {
-        delete queuedFrames.front();
-        queuedFrames.pop();
+    // shared by every connection, never freed
+    static FrameBuffer* const ping = FrameBuffer::format(WsOpcode::Ping, "", 0);
+    if (pinged && !heard) {
+        socket->connected = false;
+        return;
+    }
+    bool quiet = !heard;
+    heard = pinged = false;
+    if (!closing && opts()->IdleTimeout &&
+        socket->poll->timers.tick() - lastMessage >= opts()->IdleTimeout)
+        fail(WsClose::GoingAway);
+    // a close frame waits for its answer like a ping
+    if (closing)
+        pinged = true;
+    else if (quiet && opts()->PingInterval) {
+        queueFrame(ping->retain());
+        pinged = true;
     }
+    schedule();
 }
 
-void WebSocketSession::readyFrames()
+void WebSocketSession::schedule()
 {
-    while (!webSocket->queuedMessages.empty()) {
-        auto&& message = webSocket->queuedMessages.front();
-        formatFrames(message->payload, message->payloadSize, message->opcode);
-        delete message;
-        webSocket->queuedMessages.pop();
+    uint32_t next = pinged ? opts()->PongTimeout : opts()->PingInterval;
+    if (opts()->IdleTimeout && !closing) {
+        uint32_t idle = lastMessage + opts()->IdleTimeout - socket->poll->timers.tick();
+        if (!next || idle < next) next = idle;
     }
+    if (next) socket->poll->timers.schedule(this, next);
 }
 
-void WebSocketSession::onAwakePre() { readyFrames(); }
-void WebSocketSession::onAwakePost() { readyFrames(); }
+WebSocketSession::~WebSocketSession()
+{
+    socket->poll->timers.cancel(this);
+    if (!subscriptions.empty()) socket->poll->pubsub.unsubscribeAll(this);
+    Arena::destroy(webSocket);
+    delete deflater;
+    delete inflater;
+    for (size_t i = frontFrame; i < queuedFrames.size(); i++)
+        queuedFrames[i]->release();
+}
 
-// receives and writes one message at a time
+void WebSocketSession::onAwakePre()
+{
+    if (timer.due.load(std::memory_order_relaxed) && timer.due.exchange(false)) heartbeat();
+}
+void WebSocketSession::onAwakePost()
+{
+    // a sender paused by backpressure can go on
+    if (congested && !closing && bufferedAmount() <= opts()->MaxBackpressure / 2) {
+        congested = false;
+        socket->server->dispatch(WsEvent::DRAIN, webSocket);
+        socket->arena.rewind(messageMark);
+    }
+}
+
+// receives one message at a time, writes as many queued frames as one send takes
 void WebSocketSession::onWritable()
 {
-    if (!queuedFrames.empty()) {
-        auto&& frame   = queuedFrames.front();
-        int    toWrite = (int)(frame->size - writeOffset);
-        bool   final   = queuedFrames.size() == 1;
-        writeOffset += socket->write(frame->data + writeOffset, toWrite, final);
-        assert(writeOffset <= frame->size && "How did write exceed frame size?");
-        if (writeOffset == frame->size) {
+    static const int MaxBatch = 256;
+    if (frontFrame < queuedFrames.size()) {
+        // frames go straight from the queue, never through the thread's cork. a shared poll can
+        // serve the socket's next write on another thread, which would strand a corked frame
+        iovec  buffers[MaxBatch];
+        int    count = 0;
+        size_t total = 0;
+        for (size_t i = frontFrame; i < queuedFrames.size() && count < MaxBatch &&
+                                    total < (size_t)ClientSocket::MaxWriteSize;
+             i++) {
+            FrameBuffer* frame  = queuedFrames[i];
+            size_t       offset = i == frontFrame ? writeOffset : 0;
+            buffers[count++]    = {frame->data() + offset, frame->size - offset};
+            total += frame->size - offset;
+            // nothing may follow a close frame onto the wire
+            if (frame->opcode == WsOpcode::Close) break;
+        }
+        size_t wrote = socket->writev(buffers, count);
+        assert(wrote <= total && "How did write exceed the frames given?");
+        buffered -= wrote;
+        while (wrote) {
+            FrameBuffer* frame = queuedFrames[frontFrame];
+            size_t       left  = frame->size - writeOffset;
+            if (wrote < left) {
+                writeOffset += wrote;
+                break;
+            }
+            wrote -= left;
             if (frame->opcode == WsOpcode::Close) socket->connected = false;
-            freeFrame(frame);
-            queuedFrames.pop();
+            frame->release();
             writeOffset = 0;
+            frontFrame++;
+        }
+        // the written ones are dropped once they are half the queue, it never shifts per frame
+        if (frontFrame == queuedFrames.size()) {
+            queuedFrames.clear();
+            frontFrame = 0;
+        }
+        else {
+            if (frontFrame >= 64 && frontFrame * 2 >= queuedFrames.size()) {
+                queuedFrames.erase(queuedFrames.begin(), queuedFrames.begin() + frontFrame);
+                frontFrame = 0;
+            }
+            // a batch taken whole leaves the rest for the next writable event
+            socket->wantWrite = true;
         }
     }
+    // an idle connection left armed for writing would be served on every loop iteration
+    else if (socket->writeBuffer.empty())
+        socket->wantWrite = false;
+    else
+        socket->write(nullptr, 0, true);
 }
 void WebSocketSession::onData(const std::string_view& data)
 {
-    auto [shouldClose, complete] = parseFrame(data);
-    if (shouldClose)
-        socket->disconnect();
-    else if (complete) {
-        webSocket->currentMessage = new WsMessage((WsOpcode)currentFrame->header.opcode,
-                                                  payloadBuffer.c_str(),
-                                                  currentFrame->payloadLength);
-        assert(currentFrame->header.opcode != 0 && "How is the opcode zero here?");
-        switch (currentFrame->header.opcode) {
-            case 1:
-            case 2: socket->server->dispatch(WsEvent::MESSAGE, webSocket); break;
-            case 8:
-                // actually close the socket after writing close frame
-                formatFrames(payloadBuffer.c_str(), payloadBuffer.length(), WsOpcode::Close);
-                socket->server->dispatch(WsEvent::CLOSE, webSocket);
-                break;
-            case 9:
-                formatFrames(payloadBuffer.c_str(), payloadBuffer.size(), WsOpcode::Pong);
-                socket->server->dispatch(WsEvent::PING, webSocket);
-                break;
-            case 10: socket->server->dispatch(WsEvent::PONG, webSocket); break;
-            default:
-                std::cout << "Unsupported opcode! on socket " << socket->id << " from ip "
-                          << socket->ip << std::endl;
-                break;
-        }
-        payloadBuffer.clear();
-        freeWsFrame(currentFrame);
-        delete webSocket->currentMessage;
-        currentFrame              = nullptr;
-        webSocket->currentMessage = nullptr;
+    // the receive buffer belongs to the loop and isn't read again until this returns, so payloads
+    // are unmasked where they lie. one read can hold many frames or end inside one
+    char*       pos = (char*)data.data();
+    const char* end = pos + data.size();
+    heard           = true;
+    while (!closing && (pos < end || inFrame)) {
+        if (!inFrame && (!readHeader(pos, end) || !inFrame)) break;
+        readPayload(pos, end);
+        if (inFrame) break;
     }
 }
 
@@ -1,8 +1,12 @@
 #ifndef __CW_WEB_SOCKET_FRAME_H_
 #define __CW_WEB_SOCKET_FRAME_H_
 
-#include <queue>
+#include <vector>
+#include "FrameBuffer.h"
+#include "PerMessageDeflate.h"
+#include "PubSub.h"
 #include "Session.h"
+#include "TimerWheel.h"
 #include "WebSocket.h"
 
 // 0                   1                   2                   3
@@ -26,69 +30,155 @@
 
 namespace cW {
 
-struct WebSocketOpts {
-    size_t MaxPayloadLength = 1024 * 1024;
-};
 class WebSocketSession : Session {
 
     friend class Poll;
     friend class ClientSocket;
     friend class Server;
+    friend class WebSocket;
+    friend class PubSub;
+    friend class TimerWheel;
 
-    // formated binary frame
-    struct Frame {
+    // frame being received
+    struct WsFrame {
         WsOpcode opcode;
-        char*    data;
-        size_t   size;
+        bool     fin;
+        uint8_t  mask[4];
+        size_t   payloadLength;
+        size_t   readOffset;
     };
-    struct WsFrameHeader {
-        uint8_t opcode : 4;
-        bool    rsv3 : 1;
-        bool    rsv2 : 1;
-        bool    rsv1 : 1;
-        bool    fin : 1;
-        uint8_t payloadLenShort : 7;
-        bool    mask : 1;
+    // close status codes
+    enum WsClose : uint16_t {
+        Normal        = 1000,
+        GoingAway     = 1001,
+        ProtocolError = 1002,
+        InvalidData   = 1007,
+        Policy        = 1008,
+        TooBig        = 1009
     };
-    struct WsFrame {
-        WsFrameHeader header;
-        size_t        payloadLength;
-        uint8_t       mask[4];
-        size_t        readOffset;
-    };
-    static inline void freeWsFrame(WsFrame* frame);
-    static inline void freeFrame(Frame* frame);
 
-    std::queue<Frame*> queuedFrames;
-    // continuation buffer for current frame
+    // frames waiting to be written, the ones before frontFrame already were. published frames
+    // are shared with other sessions
+    std::vector<FrameBuffer*> queuedFrames;
+    size_t                    frontFrame  = 0;
+    size_t                    writeOffset = 0;
+    // what is left of them to write
+    size_t buffered = 0;
+    // reached MaxBackpressure, drain is due once it is back under half
+    bool congested = false;
+
+    // the longest header is 14 bytes, one split across reads waits here
+    uint8_t headerBuffer[14];
+    uint8_t headerBuffered = 0;
+    WsFrame frame;
+    bool    inFrame = false;
+    // data frames of a fragmented message, or one that didn't arrive in a single read
     std::string payloadBuffer;
-    WsFrame*    currentFrame;
+    WsOpcode    messageOpcode     = WsOpcode::Text;
+    bool        fragmentPending   = false;
+    bool        messageCompressed = false;
+    // control frames can arrive between fragments so they get their own, at most 125 bytes
+    char controlBuffer[125];
+    // the route has a stream handler, data goes to it as it is read and payloadBuffer stays empty
+    bool streaming = false;
+    // of the current streamed message, inflated
+    size_t streamed = 0;
+    // nothing more is read once a close frame was sent or received
+    bool closing = false;
 
     WebSocket* webSocket;
-
-    bool framePending    = false;
-    bool fragmentPending = false;
-
-    WebSocketOpts opts;
-
-    size_t      writeOffset = 0;
-    std::string requestHeader;
-
-    WebSocketSession(ClientSocket* socket);
-
-    //[shouldCancel, complete]
-    std::pair<bool, bool> parseFrame(const std::string_view& data);
-
-    static inline void unMask(uint8_t* payload, size_t payloadLength, uint8_t (&mask)[4]);
-
-    // format frames and add them to the queue
-    void formatFrames(const char* payload, size_t payloadLength, WsOpcode opcode);
-
-    void cleanUp();
+    // the connection arena past the session and its request. what a handler allocates there, like
+    // a decoded query, is given back once it returns
+    Arena::Mark messageMark;
+
+    // the route's, set before its open handler runs
+    inline const WebSocketOpts* opts() const { return webSocket->opts; }
+
+    // permessage-deflate once negotiated. dedicated streams are made for the first message that
+    // needs one, without context takeover the loop's shared ones are used instead
+    bool          compression = false;
+    DeflateParams deflateParams;
+    WsDeflater*   deflater = nullptr;
+    WsInflater*   inflater = nullptr;
+
+    // topics on this socket's loop
+    std::vector<PubSub::Subscription> subscriptions;
+    // published frames were queued, written once the whole batch is
+    bool flushPending = false;
+
+    // heartbeat on the loop's wheel. heard is anything read since it last ran, pinged a ping or
+    // close frame waiting for an answer
+    TimerWheel::Entry timer;
+    bool              heard       = false;
+    bool              pinged      = false;
+    uint32_t          lastMessage = 0;
+
+    WebSocketSession(ClientSocket* socket, const std::string_view& requestHeader);
+
+    // validates the upgrade, runs the open handler and answers with a 101 in one write. anything
+    // else is refused and the connection closed
+    void handshake();
+    void refuse(const std::string_view& response);
+
+    // consumes the next frame header, buffering it when it is split. false on a protocol error,
+    // which has already started closing
+    bool readHeader(char*& data, const char* end);
+    // consumes what the receive buffer holds of the current frame's payload
+    void readPayload(char*& data, const char* end);
+    // runs the handler for a complete message or control frame
+    void deliver(WsOpcode opcode, const std::string_view& payload);
+    // a piece of the current data frame on a streaming route, inflated first when compressed
+    void stream(const std::string_view& data, bool last);
+    // runs the stream handler, false once the connection is closing
+    bool deliverPiece(const std::string_view& piece, bool last);
+    // empty, or a status code a peer may send followed by a utf-8 reason
+    static bool validClose(const std::string_view& payload);
+    // sends a close frame with code and stops reading
+    void fail(WsClose code);
+
+    // unmasks while copying out of the receive buffer, offset is how much of the payload came before
+    static inline void unMask(char* dest, const char* src, size_t size, const uint8_t (&mask)[4],
+                              size_t offset);
+
+    WsDeflater* compressor();
+    WsInflater* decompressor();
+
+    // format frames and add them to the queue, compressed marks the message with rsv1
+    void formatFrames(const char* payload,
+                      size_t      payloadLength,
+                      WsOpcode    opcode,
+                      bool        compressed = false);
+
+    void queueFrame(FrameBuffer* frame);
+    // a message this connection compresses or splits can't go out as a frame made beforehand
+    bool reframes(WsOpcode opcode, size_t size) const;
+    // compressed when negotiated and long enough, split at MaxPayloadLength
+    void formatMessage(WsOpcode opcode, const std::string_view& payload);
+    // a message from the application. false under backpressure, see WebSocket::sendMessage
+    bool send(WsOpcode opcode, const std::string_view& payload);
+    bool send(FrameBuffer* frame);
+    bool send(WsOpcode opcode, size_t size, const std::function<void(char*)>& write);
+    // queued messages and frames, and what the socket holds back
+    size_t bufferedAmount() const;
+    // at MaxBackpressure, the connection is congested until drained
+    bool overLimit();
+    // before queueing a message, false if the route's backpressure policy doesn't let it in
+    bool admit(bool published);
+    // discards what hasn't started going out and closes with 1008
+    void shed();
+    // writes queued frames until the socket takes no more
+    void writeFrames();
+
+    bool subscribe(const std::string_view& topic);
+    bool unsubscribe(const std::string_view& topic);
+
+    // runs once the timer is due: pings a quiet peer, drops one that didn't answer, closes an
+    // idle one
+    void heartbeat();
+    // the timer for whatever is due next, if anything is
+    void schedule();
 
     ~WebSocketSession();
-    // receives and writes one message at a time
-    void readyFrames();
     void onAwakePre() override;
     void onAwakePost() override;
     void onAborted() override;
@@ -97,22 +187,10 @@ class WebSocketSession : Session {
     bool shouldEnd() override;
 };
 
-void WebSocketSession::unMask(uint8_t* payload, size_t payloadLength, uint8_t (&mask)[4])
-{
-    for (size_t i = 0; i < payloadLength; i++)
-        payload[i] ^= mask[i % 4];
-}
-
-void WebSocketSession::freeWsFrame(WsFrame* frame)
-{
-    if (frame) { free(frame); };
-}
-void WebSocketSession::freeFrame(Frame* frame)
+void WebSocketSession::unMask(char* dest, const char* src, size_t size, const uint8_t (&mask)[4],
+                              size_t offset)
 {
-    if (frame) {
-        free(frame->data);
-        free(frame);
-    }
+    ws_unmask(dest, src, size, mask, offset);
 }
 
 } // namespace cW
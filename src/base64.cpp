@@ -114,9 +114,13 @@ static std::string encode(String s, bool url)
 
 std::string base64_encode(unsigned char const* bytes_to_encode, size_t in_len, bool url)
 {
+    std::string ret((in_len + 2) / 3 * 4, '\0');
+    base64_encode(bytes_to_encode, in_len, ret.data(), url);
+    return ret;
+}
 
-    size_t len_encoded = (in_len + 2) / 3 * 4;
-
+size_t base64_encode(unsigned char const* bytes_to_encode, size_t in_len, char* out, bool url)
+{
     unsigned char trailing_char = url ? '.' : '=';
 
     //
@@ -130,39 +134,37 @@ std::string base64_encode(unsigned char const* bytes_to_encode, size_t in_len, b
     //
     const char* base64_chars_ = base64_chars[url];
 
-    std::string ret;
-    ret.reserve(len_encoded);
-
-    unsigned int pos = 0;
+    char*  ret = out;
+    size_t pos = 0;
 
     while (pos < in_len) {
-        ret.push_back(base64_chars_[(bytes_to_encode[pos + 0] & 0xfc) >> 2]);
+        *ret++ = base64_chars_[(bytes_to_encode[pos + 0] & 0xfc) >> 2];
 
         if (pos + 1 < in_len) {
-            ret.push_back(base64_chars_[((bytes_to_encode[pos + 0] & 0x03) << 4) +
-                                        ((bytes_to_encode[pos + 1] & 0xf0) >> 4)]);
+            *ret++ = base64_chars_[((bytes_to_encode[pos + 0] & 0x03) << 4) +
+                                   ((bytes_to_encode[pos + 1] & 0xf0) >> 4)];
 
             if (pos + 2 < in_len) {
-                ret.push_back(base64_chars_[((bytes_to_encode[pos + 1] & 0x0f) << 2) +
-                                            ((bytes_to_encode[pos + 2] & 0xc0) >> 6)]);
-                ret.push_back(base64_chars_[bytes_to_encode[pos + 2] & 0x3f]);
+                *ret++ = base64_chars_[((bytes_to_encode[pos + 1] & 0x0f) << 2) +
+                                       ((bytes_to_encode[pos + 2] & 0xc0) >> 6)];
+                *ret++ = base64_chars_[bytes_to_encode[pos + 2] & 0x3f];
             }
             else {
-                ret.push_back(base64_chars_[(bytes_to_encode[pos + 1] & 0x0f) << 2]);
-                ret.push_back(trailing_char);
+                *ret++ = base64_chars_[(bytes_to_encode[pos + 1] & 0x0f) << 2];
+                *ret++ = trailing_char;
             }
         }
         else {
 
-            ret.push_back(base64_chars_[(bytes_to_encode[pos + 0] & 0x03) << 4]);
-            ret.push_back(trailing_char);
-            ret.push_back(trailing_char);
+            *ret++ = base64_chars_[(bytes_to_encode[pos + 0] & 0x03) << 4];
+            *ret++ = trailing_char;
+            *ret++ = trailing_char;
         }
 
         pos += 3;
     }
 
-    return ret;
+    return ret - out;
 }
 
 template <typename String>
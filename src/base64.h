@@ -19,6 +19,8 @@ std::string base64_encode_mime(std::string const& s);
 
 std::string base64_decode(std::string const& s, bool remove_linebreaks = false);
 std::string base64_encode(unsigned char const*, size_t len, bool url = false);
+// encodes into out, which must hold (len + 2) / 3 * 4 chars. returns the encoded length
+size_t base64_encode(unsigned char const*, size_t len, char* out, bool url = false);
 
 #if __cplusplus >= 201703L
 //
@@ -0,0 +1,83 @@
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include "src/Utils.h"
+
+using namespace cW;
+
+// what unMask used to do, one byte at a time
+void unmaskBytewise(char* dest, const char* src, size_t size, const uint8_t (&mask)[4])
+{
+    for (size_t i = 0; i < size; i++)
+        dest[i] = src[i] ^ mask[i % 4];
+}
+
+// single thread, source offset by one so neither side starts aligned
+template <typename Unmask>
+double bench(size_t size, bool inPlace, Unmask&& unmask)
+{
+    using namespace std::chrono;
+    std::vector<char> src(size + 1), dest(size + 1);
+    std::mt19937      rng(42);
+    for (char& c : src)
+        c = (char)rng();
+    char* from = src.data() + 1;
+    char* to   = inPlace ? from : dest.data();
+
+    size_t rounds  = 0;
+    auto   start   = steady_clock::now();
+    double elapsed = 0;
+    while (elapsed < 0.2) {
+        for (int i = 0; i < 64; i++)
+            unmask(to, from, size);
+        rounds += 64;
+        elapsed = duration<double>(steady_clock::now() - start).count();
+    }
+    return (double)size * rounds / elapsed / (1024 * 1024 * 1024);
+}
+
+bool verify(const uint8_t (&mask)[4])
+{
+    std::vector<char> src(4096), expected(4096), actual(4096);
+    std::mt19937      rng(7);
+    for (char& c : src)
+        c = (char)rng();
+    // every split point of a frame arriving in two reads, at every alignment
+    for (size_t size : {1, 3, 15, 16, 17, 63, 64, 65, 127, 1000, 4000})
+        for (size_t split = 0; split <= size; split += 1 + size / 16)
+            for (size_t align = 0; align < 8; align++) {
+                unmaskBytewise(expected.data(), src.data(), size, mask);
+                ws_unmask(actual.data() + align, src.data(), split, mask);
+                ws_unmask(actual.data() + align + split, src.data() + split, size - split, mask,
+                          split);
+                if (std::memcmp(expected.data(), actual.data() + align, size)) {
+                    printf("mismatch at size %zu split %zu align %zu\n", size, split, align);
+                    return false;
+                }
+            }
+    return true;
+}
+
+int main()
+{
+    const uint8_t mask[4] = {0x37, 0xfa, 0x21, 0x3d};
+    if (!verify(mask)) return 1;
+
+    printf("kernel %s\n", ws_unmask_kernel());
+    printf("%10s %14s %14s %14s\n", "payload", "bytewise GB/s", "copy GB/s", "in place GB/s");
+    for (size_t size : {16, 64, 256, 1024, 4 * 1024, 64 * 1024, 1024 * 1024}) {
+        double bytewise = bench(size, false, [&](char* dest, const char* src, size_t size) {
+            unmaskBytewise(dest, src, size, mask);
+        });
+        double copy     = bench(size, false, [&](char* dest, const char* src, size_t size) {
+            ws_unmask(dest, src, size, mask);
+        });
+        double inPlace  = bench(size, true, [&](char* dest, const char* src, size_t size) {
+            ws_unmask(dest, src, size, mask);
+        });
+        printf("%10zu %14.2f %14.2f %14.2f\n", size, bytewise, copy, inPlace);
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include "src/PerMessageDeflate.h"
+
+using namespace cW;
+
+// a feed of small json updates, the kind of stream context takeover pays off on
+std::vector<std::string> makeMessages(size_t count)
+{
+    static const char* symbols[] = {"AAPL", "MSFT", "GOOG", "AMZN", "NVDA", "META", "TSLA"};
+    std::mt19937             rng(42);
+    std::vector<std::string> messages;
+    for (size_t i = 0; i < count; i++) {
+        char buffer[256];
+        int  length = snprintf(buffer, sizeof(buffer),
+                               "{\"type\":\"trade\",\"symbol\":\"%s\",\"price\":%u.%02u,"
+                               "\"size\":%u,\"exchange\":\"XNAS\",\"sequence\":%zu,"
+                               "\"conditions\":[\"@\",\"F\"],\"timestamp\":%zu}",
+                               symbols[rng() % 7], (unsigned)(100 + rng() % 400),
+                               (unsigned)(rng() % 100), (unsigned)(1 + rng() % 1000), 1000000 + i,
+                               1700000000000 + i * 37);
+        messages.emplace_back(buffer, length);
+    }
+    return messages;
+}
+
+// single thread, every message compressed and inflated back like a connection would
+void bench(const char* name, const std::vector<std::string>& messages, WsDeflater& deflater,
+           WsInflater& inflater, size_t connectionMemory)
+{
+    using namespace std::chrono;
+    size_t      raw = 0, wire = 0, rounds = 0;
+    std::string compressed, inflated;
+    auto        start   = steady_clock::now();
+    double      elapsed = 0;
+    while (elapsed < 0.5) {
+        for (const std::string& message : messages) {
+            compressed.clear();
+            inflated.clear();
+            deflater.compress(message, compressed);
+            if (!inflater.inflate(compressed, inflated, 1 << 20) || inflated != message) {
+                printf("%s: round trip failed\n", name);
+                return;
+            }
+            raw += message.size();
+            wire += compressed.size();
+        }
+        rounds += messages.size();
+        elapsed = duration<double>(steady_clock::now() - start).count();
+    }
+    printf("%-22s %8.3f %12.1f %14zu\n", name, (double)wire / raw,
+           raw / elapsed / (1024 * 1024), connectionMemory);
+}
+
+int main()
+{
+    std::vector<std::string> messages = makeMessages(1000);
+    printf("%zu messages, %zu bytes on average\n", messages.size(),
+           [&] {
+               size_t total = 0;
+               for (auto& message : messages)
+                   total += message.size();
+               return total / messages.size();
+           }());
+    printf("%-22s %8s %12s %14s\n", "mode", "ratio", "MB/s", "bytes/conn");
+
+    {
+        // nothing is kept per connection, the loop's compressor serves all of them
+        WsDeflater& deflater = *WsDeflater::shared(6, 15);
+        WsInflater  inflater(15, false);
+        bench("shared", messages, deflater, inflater, 0);
+    }
+    for (int windowBits : {9, 10, 11, 12, 13, 15}) {
+        WsDeflater deflater(6, windowBits, true);
+        WsInflater inflater(windowBits, true);
+        char       name[32];
+        snprintf(name, sizeof(name), "dedicated %d bits", windowBits);
+        // what both ends hold once the first message set up their windows
+        std::string compressed, inflated;
+        deflater.compress(messages[0], compressed);
+        inflater.inflate(compressed, inflated, 1 << 20);
+        size_t memory = deflater.memory() + inflater.memory();
+        bench(name, messages, deflater, inflater, memory);
+    }
+    return 0;
+}